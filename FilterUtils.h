@@ -25,10 +25,42 @@ namespace KK5JY {
 		// macro to convert integer data type into right-shift value for fixed-point multiplications
 		#define IIRFILTER_INTEGER_SHIFT(datatype) ((sizeof(datatype) * 8) - 2)
 
+		// block size used when measuring filter gain
+		#define KK5JY_FILTERUTILS_BLOCK (256)
+
 		//
 		//  class FilterUtils - common filter code
 		//
 		class FilterUtils {
+			private:
+				//
+				//  RunGain(filter, source, samples, peak) - run 2 * 'samples' from the
+				//     oscillator through the filter a block at a time; return the
+				//     larger of 'peak' and the output peak after the first 'samples'
+				//
+				template <typename sample_t>
+				inline static double RunGain(IFilter<sample_t> *filter, Nco<sample_t> &source, size_t samples, double peak) {
+					sample_t buffer[KK5JY_FILTERUTILS_BLOCK];
+					for (size_t i = 0; i < 2 * samples; ) {
+						size_t ct = 2 * samples - i;
+						if (ct > KK5JY_FILTERUTILS_BLOCK)
+							ct = KK5JY_FILTERUTILS_BLOCK;
+
+						// generate and filter the block in place
+						source.read(buffer, ct);
+						filter->process(buffer, ct);
+
+						// track the peak once the filter has settled
+						for (size_t j = 0; j != ct; ++j, ++i) {
+							double output = std::abs(buffer[j]);
+							if (i >= samples && output > peak) {
+								peak = output;
+							}
+						}
+					}
+					return peak;
+				}
+
 			public:
 				//
 				//  CalculateGain(filter, fs, f*, count) - calculate the peak gain at one or more frequencies.
@@ -39,15 +71,10 @@ namespace KK5JY {
 
 					for (double *f = freqs; *f > 0; ++f) {
 						// build an oscillator at the test frequency
-						Osc<sample_t> source(*f, fs);
+						Nco<sample_t> source(*f, fs);
 
 						// run 2 * 'samples' through the filter, and track the peak
-						for (size_t i = 0; i != 2 * samples; ++i) {
-							sample_t output = std::abs(filter->run(source.read()));
-							if (i >= samples && output > peak) {
-								peak = output;
-							}
-						}
+						peak = RunGain(filter, source, samples, peak);
 
 						// clear the filter state
 						filter->clear();
@@ -67,15 +94,10 @@ namespace KK5JY {
 
 					for (double *f = Omegas; *f > 0; ++f) {
 						// build an oscillator at the test frequency
-						Osc<sample_t> source(*f);
+						Nco<sample_t> source(*f);
 
 						// run 2 * 'samples' through the filter, and track the peak
-						for (size_t i = 0; i != 2 * samples; ++i) {
-							sample_t output = std::abs(filter->run(source.read()));
-							if (i >= samples && output > peak) {
-								peak = output;
-							}
-						}
+						peak = RunGain(filter, source, samples, peak);
 
 						// clear the filter state
 						filter->clear();
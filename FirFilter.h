@@ -21,6 +21,14 @@
 #include <exception>
 #include <string>
 #include <algorithm>
+#include <stdint.h>
+
+// vector extensions for the filter cores
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "WindowFunctions.h"
 #include "FilterTypes.h"
@@ -204,87 +212,200 @@ namespace KK5JY {
 
 			public:
 				//
-				// FIR filter core (int16).
+				// Dot product cores; 'x' and 'h' are contiguous, so these vectorize.
 				//
-				static int16_t Filter(int16_t input, int16_t *&hp, int16_t * const history, int16_t * const hist_end, int16_t * const coefs, int16_t * const coef_end) {
-					int16_t* cp = coefs;
 
-					// store the input sample and wrap the history pointer
-					*hp++ = input;
-					if (hp == hist_end) {
-						hp = history;
+				// single precision
+				static float Dot(const float *x, const float *h, size_t n) {
+					size_t i = 0;
+					float result = 0.0f;
+					#if defined(__AVX__)
+					__m256 acc0 = _mm256_setzero_ps();
+					__m256 acc1 = _mm256_setzero_ps();
+					for ( ; i + 16 <= n; i += 16) {
+						#if defined(__FMA__)
+						acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i), acc0);
+						acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(h + i + 8), acc1);
+						#else
+						acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i)));
+						acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(h + i + 8)));
+						#endif
+					}
+					acc0 = _mm256_add_ps(acc0, acc1);
+					__m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+					for ( ; i + 4 <= n; i += 4) {
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+					}
+					acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+					acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+					result = _mm_cvtss_f32(acc);
+					#elif defined(__SSE__)
+					__m128 acc0 = _mm_setzero_ps();
+					__m128 acc1 = _mm_setzero_ps();
+					for ( ; i + 8 <= n; i += 8) {
+						acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+						acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+					}
+					acc0 = _mm_add_ps(acc0, acc1);
+					acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+					acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+					result = _mm_cvtss_f32(acc0);
+					#elif defined(__ARM_NEON)
+					float32x4_t acc0 = vdupq_n_f32(0.0f);
+					float32x4_t acc1 = vdupq_n_f32(0.0f);
+					for ( ; i + 8 <= n; i += 8) {
+						acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(h + i));
+						acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+					}
+					acc0 = vaddq_f32(acc0, acc1);
+					float32x2_t acc2 = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+					result = vget_lane_f32(vpadd_f32(acc2, acc2), 0);
+					#else
+					float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+					for ( ; i + 4 <= n; i += 4) {
+						a0 += x[i] * h[i];
+						a1 += x[i + 1] * h[i + 1];
+						a2 += x[i + 2] * h[i + 2];
+						a3 += x[i + 3] * h[i + 3];
 					}
+					result = (a0 + a1) + (a2 + a3);
+					#endif
+					for ( ; i != n; ++i) {
+						result += x[i] * h[i];
+					}
+					return result;
+				}
 
-					// run the filter
-					int16_t output = 0;
-					while (cp != coef_end) {
-						// multiply and accumulate
-						output += (*hp++ * *cp++) >> 15;
+				// double precision
+				static double Dot(const double *x, const double *h, size_t n) {
+					size_t i = 0;
+					double result = 0.0;
+					#if defined(__AVX__)
+					__m256d acc0 = _mm256_setzero_pd();
+					__m256d acc1 = _mm256_setzero_pd();
+					for ( ; i + 8 <= n; i += 8) {
+						#if defined(__FMA__)
+						acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(h + i), acc0);
+						acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(h + i + 4), acc1);
+						#else
+						acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(h + i)));
+						acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(h + i + 4)));
+						#endif
+					}
+					acc0 = _mm256_add_pd(acc0, acc1);
+					__m128d acc = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+					acc = _mm_add_sd(acc, _mm_unpackhi_pd(acc, acc));
+					result = _mm_cvtsd_f64(acc);
+					#elif defined(__SSE2__)
+					__m128d acc0 = _mm_setzero_pd();
+					__m128d acc1 = _mm_setzero_pd();
+					for ( ; i + 4 <= n; i += 4) {
+						acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(h + i)));
+						acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(h + i + 2)));
+					}
+					acc0 = _mm_add_pd(acc0, acc1);
+					acc0 = _mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0));
+					result = _mm_cvtsd_f64(acc0);
+					#else
+					double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+					for ( ; i + 4 <= n; i += 4) {
+						a0 += x[i] * h[i];
+						a1 += x[i + 1] * h[i + 1];
+						a2 += x[i + 2] * h[i + 2];
+						a3 += x[i + 3] * h[i + 3];
+					}
+					result = (a0 + a1) + (a2 + a3);
+					#endif
+					for ( ; i != n; ++i) {
+						result += x[i] * h[i];
+					}
+					return result;
+				}
 
-						// and make sure to wrap the history pointer
-						if (hp == hist_end) {
-							hp = history;
-						}
+				// Q15 fixed point; returns the full-precision Q30 sum
+				static int64_t Dot(const int16_t *x, const int16_t *h, size_t n) {
+					size_t i = 0;
+					int64_t result = 0;
+					#if defined(__SSE2__)
+					__m128i acc = _mm_setzero_si128();
+					for ( ; i + 8 <= n; i += 8) {
+						__m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+						__m128i hv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+						acc = _mm_add_epi32(acc, _mm_madd_epi16(xv, hv));
+					}
+					int32_t lanes[4];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+					result = static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+					#elif defined(__ARM_NEON)
+					int32x4_t acc = vdupq_n_s32(0);
+					for ( ; i + 4 <= n; i += 4) {
+						acc = vmlal_s16(acc, vld1_s16(x + i), vld1_s16(h + i));
 					}
+					result = static_cast<int64_t>(vgetq_lane_s32(acc, 0)) + vgetq_lane_s32(acc, 1) +
+						vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+					#endif
+					for ( ; i != n; ++i) {
+						result += static_cast<int32_t>(x[i]) * h[i];
+					}
+					return result;
+				}
 
-					// return the result
-					return output;
+				// round a Q30 sum back to Q15, saturating
+				static int16_t SaturateQ15(int64_t acc) {
+					acc = (acc + (1 << 14)) >> 15;
+					if (acc > 32767)
+						return 32767;
+					if (acc < -32768)
+						return -32768;
+					return static_cast<int16_t>(acc);
 				}
 
 				//
-				// FIR filter core (single precision).
+				// FIR filter core (int16).
 				//
-				static float Filter(float input, float *&hp, float * const history, float * const hist_end, float * const coefs, float * const coef_end) {
-					float* cp = coefs;
-
-					// store the input sample and wrap the history pointer
-					*hp++ = input;
-					if (hp == hist_end) {
-						hp = history;
+				// The history buffer holds 2 * 'length' samples, and each input is
+				//    stored twice (mirrored), so the 'length' newest samples are always
+				//    contiguous starting at 'history + pos', oldest first.
+				//
+				static int16_t Filter(int16_t input, size_t &pos, int16_t * const history, const size_t length, const int16_t * const coefs) {
+					history[pos] = history[pos + length] = input;
+					if (++pos == length) {
+						pos = 0;
 					}
+					return SaturateQ15(Dot(history + pos, coefs, length));
+				}
 
-					// run the filter
-					float output = 0.0f;
-					while (cp != coef_end) {
-						// multiply and accumulate
-						output += *hp++ * *cp++;
-
-						// and make sure to wrap the history pointer
-						if (hp == hist_end) {
-							hp = history;
-						}
+				//
+				// FIR filter core (single precision).
+				//
+				static float Filter(float input, size_t &pos, float * const history, const size_t length, const float * const coefs) {
+					history[pos] = history[pos + length] = input;
+					if (++pos == length) {
+						pos = 0;
 					}
-
-					// return the result
-					return output;
+					return Dot(history + pos, coefs, length);
 				}
 
 				//
 				// FIR filter core (double precision).
 				//
-				static double Filter(double input, double *&hp, double * const history, double * const hist_end, double * const coefs, double * const coef_end) {
-					double* cp = coefs;
-
-					// store the input sample and wrap the history pointer
-					*hp++ = input;
-					if (hp == hist_end) {
-						hp = history;
+				static double Filter(double input, size_t &pos, double * const history, const size_t length, const double * const coefs) {
+					history[pos] = history[pos + length] = input;
+					if (++pos == length) {
+						pos = 0;
 					}
+					return Dot(history + pos, coefs, length);
+				}
 
-					// run the filter
-					double output = 0.0;
-					while (cp != coef_end) {
-						// multiply and accumulate
-						output += *hp++ * *cp++;
-
-						// and make sure to wrap the history pointer
-						if (hp == hist_end) {
-							hp = history;
-						}
+				//
+				// FIR filter block core; runs 'count' samples from 'in' into 'out',
+				//    which may be the same buffer.
+				//
+				template <typename T>
+				static void Filter(const T *in, T *out, size_t count, size_t &pos, T * const history, const size_t length, const T * const coefs) {
+					for (size_t i = 0; i != count; ++i) {
+						out[i] = Filter(in[i], pos, history, length, coefs);
 					}
-
-					// return the result
-					return output;
 				}
 		};
 
@@ -444,11 +565,9 @@ namespace KK5JY {
 			private:
 				int m_Length;
 
-				coef_t *m_InputPos;
-				coef_t *m_History;
+				size_t m_Pos;       // oldest sample in the history
+				coef_t *m_History;  // mirrored history (2 * m_Length)
 				coef_t *m_Coefs;
-				coef_t *m_HistEnd;
-				coef_t *m_CoefEnd;
 				sample_t m_Value;
 
 				// test frequencies for gain calculation
@@ -475,11 +594,11 @@ namespace KK5JY {
 				void Clear() {
 					if (m_History) {
 						coef_t *h = m_History;
-						for (int i = 0; i != m_Length; ++i) {
+						for (int i = 0; i != 2 * m_Length; ++i) {
 							*h++ = 0;
 						}
 					}
-					m_InputPos = m_History;
+					m_Pos = 0;
 					m_Value = 0;
 				}
 
@@ -504,7 +623,18 @@ namespace KK5JY {
 				//  run the filter on a new input value, and return the new output value
 				//
 				sample_t run(sample_t sample) {
-					return (m_Value = FirFilterUtils::Filter(sample, m_InputPos, m_History, m_HistEnd, m_Coefs, m_CoefEnd));
+					return (m_Value = FirFilterUtils::Filter(sample, m_Pos, m_History, m_Length, m_Coefs));
+				}
+
+				//
+				//  run the filter on a block of input values
+				//
+				using IFilter<sample_t>::process;
+				void process(const sample_t *in, sample_t *out, size_t count) {
+					if ( ! count)
+						return;
+					FirFilterUtils::Filter(in, out, count, m_Pos, m_History, m_Length, m_Coefs);
+					m_Value = out[count - 1];
 				}
 
 				//
@@ -525,11 +655,7 @@ namespace KK5JY {
 				//  clear the history
 				//
 				void clear() {
-					m_Value = 0;
-					m_InputPos = m_History;
-					while (m_InputPos != m_HistEnd)
-						*m_InputPos++ = 0;
-					m_InputPos = m_History;
+					Clear();
 				}
 		};
 
@@ -565,6 +691,7 @@ namespace KK5JY {
 			}
 
 			m_Length = length;
+			corr_f2 = -1; // only one test frequency unless set below
 			double omega_c1 = fs ? (2 * M_PI * f1 / fs) : f1;
 			double omega_c2 = fs ? (2 * M_PI * f2 / fs) : f2;
 
@@ -590,9 +717,8 @@ namespace KK5JY {
 				default:
 					throw FirFilterException("Unknown filter type specified");
 			}
-			m_History = m_InputPos = new sample_t[m_Length];
-			m_HistEnd = m_History + m_Length;
-			m_CoefEnd = m_Coefs + m_Length;
+			m_History = new coef_t[2 * m_Length];
+			Clear();
 		}
 
 
@@ -611,6 +737,7 @@ namespace KK5JY {
 			}
 
 			m_Length = length;
+			corr_f2 = -1; // only one test frequency
 			double omega_c = fs ? (2 * M_PI * fc / fs) : fc;
 
 			// generate double coefs, then convert
@@ -634,9 +761,8 @@ namespace KK5JY {
 				default:
 					throw FirFilterException("Unknown filter type specified");
 			}
-			m_History = m_InputPos = new sample_t[m_Length];
-			m_HistEnd = m_History + m_Length;
-			m_CoefEnd = m_Coefs + m_Length;
+			m_History = new coef_t[2 * m_Length];
+			Clear();
 		}
 
 
@@ -650,18 +776,172 @@ namespace KK5JY {
 			if ((m_Length % 2) == 0)
 				++m_Length;
 			m_Coefs = new coef_t[m_Length];
-			for (size_t i = 0; i != length; ++i) {
+			for (int i = 0; i != length; ++i) {
 				m_Coefs[i] = coefs[i];
 			}
-			for (size_t i = length; i != m_Length; ++i) {
-				m_Coefs = 0;
+			for (int i = length; i != m_Length; ++i) {
+				m_Coefs[i] = 0;
 			}
 
-			m_History = m_InputPos = new sample_t[m_Length];
-			m_HistEnd = m_History + m_Length;
-			m_CoefEnd = m_Coefs + m_Length;
+			m_History = new coef_t[2 * m_Length];
+			Clear();
+		}
+
+
+		//
+		//  Polyphase decimating FIR low-pass filter
+		//
+		//  The prototype filter is split into 'factor' phases, and each input
+		//  sample is steered to its phase's delay line; one output is computed
+		//  for every 'factor' inputs, so the discarded outputs are never
+		//  calculated.  Intended for floating point sample types.
+		//
+		template <typename sample_t, typename coef_t = sample_t>
+		class FirDecimator {
+			private:
+				size_t m_Factor; // decimation factor
+				size_t m_Taps;   // taps per phase
+				size_t m_Phase;  // phase of the next input sample
+				size_t m_Pos;    // head of each delay line
+				coef_t *m_Coefs; // phase-major; phase p holds h[p], h[p + D], ...
+				sample_t *m_History; // one mirrored delay line per phase (2 * m_Taps)
+				sample_t m_Value;
+
+			private: // disallowed
+				FirDecimator(const FirDecimator&);
+				FirDecimator &operator=(const FirDecimator&);
+
+			public:
+				//
+				//  ctor for a low-pass decimator
+				//
+				FirDecimator(size_t factor, int length, double fc, size_t fs, WindowFunction wf = HammingWindow);
+				~FirDecimator();
+
+			public:
+				// the decimation factor
+				size_t GetFactor() const { return m_Factor; }
+
+				// the prototype filter length (padded to a multiple of the factor)
+				size_t GetLength() const { return m_Taps * m_Factor; }
+
+				//
+				//  filter and decimate 'count' input samples into 'out'; returns the
+				//     number of output samples written, which is at most
+				//     (count / factor) + 1; 'out' may be the same buffer as 'in'
+				//
+				size_t process(const sample_t *in, sample_t *out, size_t count);
+
+				//
+				//  return the most recent output value
+				//
+				sample_t value() const { return m_Value; }
+
+				//
+				//  clear the history
+				//
+				void clear();
+		};
+
+
+		//
+		//  FirDecimator ctor
+		//
+		template <typename sample_t, typename coef_t>
+		inline FirDecimator<sample_t, coef_t>::FirDecimator(size_t factor, int length, double fc, size_t fs, WindowFunction wf)
+				: m_Factor(factor), m_Taps(0), m_Phase(0), m_Pos(0), m_Coefs(0), m_History(0), m_Value(0) {
+			if (factor == 0)
+				throw FirFilterException("Decimation factor must be at least one");
+
+			// order must be odd
+			if ((length % 2) == 0)
+				++length;
+
+			// if no window specified, use rectangle
+			if (! wf) {
+				wf = RectangleWindow;
+			}
+
+			// build the prototype filter
+			double omega_c = fs ? (2 * M_PI * fc / fs) : fc;
+			coef_t *proto = FirFilterUtils::GenerateLowPassCoefficients<coef_t>(wf, length, omega_c);
+
+			// split it into phases, padding the tail with zeros
+			m_Taps = (length + m_Factor - 1) / m_Factor;
+			m_Coefs = new coef_t[m_Taps * m_Factor];
+			for (size_t p = 0; p != m_Factor; ++p) {
+				for (size_t k = 0; k != m_Taps; ++k) {
+					size_t n = k * m_Factor + p;
+					m_Coefs[p * m_Taps + k] = (n < static_cast<size_t>(length)) ? proto[n] : 0;
+				}
+			}
+			delete [] proto;
+
+			m_History = new sample_t[2 * m_Taps * m_Factor];
+			clear();
+		}
+
+
+		//
+		//  FirDecimator dtor
+		//
+		template <typename sample_t, typename coef_t>
+		inline FirDecimator<sample_t, coef_t>::~FirDecimator() {
+			delete [] m_Coefs;
+			delete [] m_History;
+		}
+
+
+		//
+		//  FirDecimator::clear()
+		//
+		template <typename sample_t, typename coef_t>
+		inline void FirDecimator<sample_t, coef_t>::clear() {
+			sample_t *hp = m_History;
+			sample_t * const ep = m_History + (2 * m_Taps * m_Factor);
+			while (hp != ep)
+				*hp++ = 0;
+			m_Phase = m_Factor - 1;
+			m_Pos = 0;
+			m_Value = 0;
+		}
+
+
+		//
+		//  FirDecimator::process(...)
+		//
+		//  Output m is y[m] = sum_p sum_k h[kD + p] * x[mD - kD - p]; the inputs
+		//  of each block arrive as phases D-1 ... 0, and the output is produced
+		//  once phase 0 has arrived.
+		//
+		template <typename sample_t, typename coef_t>
+		inline size_t FirDecimator<sample_t, coef_t>::process(const sample_t *in, sample_t *out, size_t count) {
+			const size_t taps = m_Taps;
+			size_t result = 0;
+
+			for (size_t i = 0; i != count; ++i) {
+				// store the sample twice, so the delay line is always contiguous
+				sample_t *line = m_History + (2 * taps * m_Phase);
+				line[m_Pos] = line[m_Pos + taps] = in[i];
+
+				if (m_Phase != 0) {
+					--m_Phase;
+					continue;
+				}
+
+				// all phases for this output are in; run each phase filter
+				sample_t acc = 0;
+				for (size_t p = 0; p != m_Factor; ++p) {
+					acc += FirFilterUtils::Dot(m_History + (2 * taps * p) + m_Pos, m_Coefs + (taps * p), taps);
+				}
+				out[result++] = m_Value = acc;
+
+				// newest sample goes one slot earlier next time
+				m_Pos = (m_Pos == 0) ? (taps - 1) : (m_Pos - 1);
+				m_Phase = m_Factor - 1;
+			}
 
-			m_InputPos = 0;
+			return result;
 		}
 	}
 }
@@ -0,0 +1,38 @@
+/*
+ *
+ *
+ *    IDecodeSink.h
+ *
+ *    Receiver interface for decode lines.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ */
+
+#ifndef __KK5JY_IDECODESINK_H
+#define __KK5JY_IDECODESINK_H
+
+#include <string>
+
+namespace KK5JY {
+	namespace FT8 {
+		class IDecodeSink {
+			public:
+				// called from the decoder thread once for each line 'jt9'
+				//    prints, as soon as it is read; 'start' is the capture
+				//    start time of the slot the line belongs to
+				virtual void decoded(double start, const std::string &line) = 0;
+
+				// called from the decoder thread after its last line, once
+				//    the decoder object is done and may be deleted
+				virtual void finished(double start) { /* nop */ };
+
+				// virtual dtor
+				virtual ~IDecodeSink() { /* nop */ };
+		};
+	}
+}
+
+#endif // __KK5JY_IDECODESINK_H
@@ -16,12 +16,21 @@
 #ifndef __KK5JY_IFILTER_H
 #define __KK5JY_IFILTER_H
 
+#include <cstddef>
+
 template <typename sample_t>
 class IFilter {
 	public:
 		// run the filter and return the updated value of the filter
 		virtual sample_t run(const sample_t sample) = 0;
 
+		// run the filter over a block of samples; 'in' and 'out' may be the
+		//    same buffer; implementations should use a non-virtual inner loop
+		virtual void process(const sample_t *in, sample_t *out, size_t count) = 0;
+
+		// run the filter over a block of samples in place
+		void process(sample_t *buffer, size_t count) { process(buffer, buffer, count); }
+
 		// update the the filter, but don't return a new output value;
 		//    this is helpful if calculating the return value is costly
 		virtual void add(const sample_t sample) = 0;
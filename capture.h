@@ -0,0 +1,179 @@
+/*
+ *
+ *
+ *    capture.h
+ *
+ *    Continuous receive audio history.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    Keeps the last few minutes of 12kHz receive audio in one buffer,
+ *    allocated up front, so that any window of it can be decoded: each
+ *    slot, the early pass, or a slot again later, shifted or deeper.
+ *    Samples are kept as 16-bit integers, the way the decoders take
+ *    them.  Time runs at exactly one sample per 1/12000 second from the
+ *    newest write; gaps (while transmitting, or lost audio) are filled
+ *    with silence, so that older audio stays where its time says.
+ *
+ */
+
+#ifndef __KK5JY_FT8_CAPTURE_H
+#define __KK5JY_FT8_CAPTURE_H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "locker.h"
+
+// how much audio to keep (seconds)
+#ifndef KK5JY_CAPTURE_SECONDS
+#define KK5JY_CAPTURE_SECONDS (240)
+#endif
+
+namespace KK5JY {
+	namespace FT8 {
+		//
+		//  class CaptureRing
+		//
+		class CaptureRing {
+			private:
+				std::vector<int16_t> m_Samples;
+				const double m_Rate;
+				uint64_t m_Count;  // samples written, ever
+				double m_Time;     // the time of sample m_Count (the next one)
+				bool m_Started;
+				mutable my::mutex m_Lock;
+
+			private: // disallowed
+				CaptureRing(const CaptureRing&);
+				CaptureRing &operator=(const CaptureRing&);
+
+			private:
+				// store samples at the head; locked
+				void store(const float *data, size_t count);
+
+			public:
+				CaptureRing(size_t seconds = KK5JY_CAPTURE_SECONDS, double rate = 12000);
+
+			public:
+				// add 'count' samples, the first of them at time 't'
+				void write(const float *data, size_t count, double t);
+
+				// copy 'count' samples starting at time 't' into 'out';
+				//    samples no longer (or not yet) held are zero; returns
+				//    the number of samples that were held
+				size_t read(double t, int16_t *out, size_t count) const;
+
+				// the time just after the newest sample
+				double newest() const;
+
+				// the time of the oldest sample held
+				double oldest() const;
+
+				// the sample rate
+				double rate() const { return m_Rate; }
+		};
+
+
+		//
+		//  CaptureRing::CaptureRing
+		//
+		inline CaptureRing::CaptureRing(size_t seconds, double rate)
+			: m_Samples(static_cast<size_t>(seconds * rate), 0), m_Rate(rate),
+			  m_Count(0), m_Time(0), m_Started(false) {
+			// nop
+		}
+
+
+		//
+		//  CaptureRing::store(...) - convert to 16-bit, the same way
+		//     libsndfile does for the WAV file
+		//
+		inline void CaptureRing::store(const float *data, size_t count) {
+			const size_t size = m_Samples.size();
+			for (size_t i = 0; i != count; ++i) {
+				double s = data ? (data[i] * 32767.0) : 0;
+				if (s > 32767.0)
+					s = 32767.0;
+				else if (s < -32768.0)
+					s = -32768.0;
+				m_Samples[(m_Count + i) % size] = static_cast<int16_t>(::lrint(s));
+			}
+			m_Count += count;
+		}
+
+
+		//
+		//  CaptureRing::write(...)
+		//
+		inline void CaptureRing::write(const float *data, size_t count, double t) {
+			my::locker lock(m_Lock);
+
+			// fill a gap of more than a few milliseconds with silence; a
+			//    smaller difference (the clock being slewed) just moves
+			//    the time of the buffer
+			if (m_Started) {
+				const double gap = (t - m_Time) * m_Rate;
+				if (gap > 0.005 * m_Rate) {
+					size_t fill = static_cast<size_t>(::llrint(gap));
+					if (fill > m_Samples.size())
+						fill = m_Samples.size();
+					store(0, fill);
+				}
+			}
+			store(data, count);
+			m_Time = t + (count / m_Rate);
+			m_Started = true;
+		}
+
+
+		//
+		//  CaptureRing::read(...)
+		//
+		inline size_t CaptureRing::read(double t, int16_t *out, size_t count) const {
+			my::locker lock(m_Lock);
+
+			// the sample at time 't', counting back from the newest
+			const int64_t end = static_cast<int64_t>(m_Count);
+			const int64_t held = static_cast<int64_t>(std::min<uint64_t>(m_Count, m_Samples.size()));
+			const int64_t first = end - static_cast<int64_t>(::llrint((m_Time - t) * m_Rate));
+
+			size_t result = 0;
+			const size_t size = m_Samples.size();
+			for (size_t i = 0; i != count; ++i) {
+				const int64_t n = first + static_cast<int64_t>(i);
+				if (m_Started && n >= end - held && n < end) {
+					out[i] = m_Samples[static_cast<uint64_t>(n) % size];
+					++result;
+				} else {
+					out[i] = 0;
+				}
+			}
+			return result;
+		}
+
+
+		//
+		//  CaptureRing::newest()
+		//
+		inline double CaptureRing::newest() const {
+			my::locker lock(m_Lock);
+			return m_Time;
+		}
+
+
+		//
+		//  CaptureRing::oldest()
+		//
+		inline double CaptureRing::oldest() const {
+			my::locker lock(m_Lock);
+			return m_Time - (std::min<uint64_t>(m_Count, m_Samples.size()) / m_Rate);
+		}
+	}
+}
+
+#endif // __KK5JY_FT8_CAPTURE_H
+
+// EOF
@@ -15,7 +15,30 @@
 #define __KK5JY_FT8_CLOCK_H
 
 #include <sys/time.h>
+#include <time.h>
 #include <math.h>
+#include <stdint.h>
+
+// how often SampleClock compares itself with the wall clock (seconds)
+#ifndef KK5JY_CLOCK_ANCHOR
+#define KK5JY_CLOCK_ANCHOR (1.0)
+#endif
+
+// a larger difference from the wall clock (seconds) is taken as a clock
+//    step or lost audio, and SampleClock starts over from the wall clock
+#ifndef KK5JY_CLOCK_STEP
+#define KK5JY_CLOCK_STEP (0.25)
+#endif
+
+// the shortest span (seconds) used to measure the sample rate
+#ifndef KK5JY_CLOCK_BASELINE
+#define KK5JY_CLOCK_BASELINE (30.0)
+#endif
+
+// the fraction of each measured time error corrected at once
+#ifndef KK5JY_CLOCK_GAIN
+#define KK5JY_CLOCK_GAIN (0.1)
+#endif
 
 namespace KK5JY {
 	namespace FT8 {
@@ -84,6 +107,153 @@ namespace KK5JY {
 			result += static_cast<double>(tv.tv_usec) / 1000000.0;
 			return result;
 		}
+
+
+		//
+		//  class SampleClock - UTC time from a count of audio samples
+		//
+		//  The sound callback calls tick() once per buffer.  The time of
+		//  each buffer is worked out from the number of samples before it,
+		//  so buffers are exactly count/rate apart, and a slot boundary
+		//  can be placed on a sample.  Once every KK5JY_CLOCK_ANCHOR
+		//  seconds, tick() reads CLOCK_REALTIME (through the vDSO, so
+		//  without a system call on Linux), slews the time a fraction of
+		//  the way to it, and measures the sound card's real sample rate
+		//  over everything since the last restart, so that drift between
+		//  the two clocks doesn't build up.
+		//
+		class SampleClock {
+			private:
+				double m_Rate;        // nominal sample rate
+				double m_Fs;          // measured sample rate
+				uint64_t m_Count;     // samples counted so far
+				uint64_t m_Next;      // m_Count of the next comparison
+				uint64_t m_AnchorCount; // the sample at m_AnchorTime
+				double m_AnchorTime;
+				uint64_t m_RefCount;  // the start of the rate measurement
+				double m_RefTime;
+				double m_Restart;     // wall time of the last restart
+				double m_Time;        // time of the current buffer
+				double m_Error;       // last difference from the wall clock
+				bool m_Anchored;
+
+			private:
+				// start over from the wall clock
+				void restart(double wall);
+
+				// compare with the wall clock
+				void observe(double wall);
+
+			public:
+				SampleClock(double rate);
+
+			public:
+				// call at the top of each sound callback, with the buffer
+				//    size; returns the time of the buffer's first sample
+				double tick(size_t count);
+
+				// the time of the current buffer's first sample
+				double now() const { return m_Time; }
+
+				// seconds into the current 'mod'-second period
+				double seconds(double mod = 60) const { return fmod(m_Time, mod); }
+
+				// the sample of the current buffer at time 't'; negative if
+				//    before the buffer
+				double offset(double t) const { return (t - m_Time) * m_Fs; }
+
+				// the measured sample rate
+				double rate() const { return m_Fs; }
+
+				// the difference from the wall clock, at the last comparison
+				double error() const { return m_Error; }
+
+				// the wall clock
+				static double wallclock();
+		};
+
+
+		//
+		//  SampleClock::SampleClock
+		//
+		inline SampleClock::SampleClock(double rate)
+			: m_Rate(rate), m_Fs(rate), m_Count(0), m_Next(0), m_AnchorCount(0), m_AnchorTime(0),
+			  m_RefCount(0), m_RefTime(0), m_Restart(0), m_Time(0), m_Error(0), m_Anchored(false) {
+			// nop
+		}
+
+
+		//
+		//  SampleClock::wallclock()
+		//
+		inline double SampleClock::wallclock() {
+			struct timespec ts;
+			::clock_gettime(CLOCK_REALTIME, &ts);
+			return static_cast<double>(ts.tv_sec) + (static_cast<double>(ts.tv_nsec) / 1e9);
+		}
+
+
+		//
+		//  SampleClock::tick(...)
+		//
+		inline double SampleClock::tick(size_t count) {
+			if (m_Count >= m_Next)
+				observe(wallclock());
+			m_Time = m_AnchorTime + (static_cast<double>(m_Count - m_AnchorCount) / m_Fs);
+			m_Count += count;
+			return m_Time;
+		}
+
+
+		//
+		//  SampleClock::restart(...)
+		//
+		inline void SampleClock::restart(double wall) {
+			m_AnchorTime = m_RefTime = m_Restart = wall;
+			m_AnchorCount = m_RefCount = m_Count;
+			m_Error = 0;
+			m_Anchored = true;
+		}
+
+
+		//
+		//  SampleClock::observe(...)
+		//
+		inline void SampleClock::observe(double wall) {
+			m_Next = m_Count + static_cast<uint64_t>(KK5JY_CLOCK_ANCHOR * m_Rate);
+			if ( ! m_Anchored) {
+				restart(wall);
+				return;
+			}
+
+			// a step of the wall clock, or lost audio
+			const double predicted = m_AnchorTime + (static_cast<double>(m_Count - m_AnchorCount) / m_Fs);
+			m_Error = wall - predicted;
+			if (fabs(m_Error) > KK5JY_CLOCK_STEP) {
+				restart(wall);
+				return;
+			}
+
+			// the callback only ever runs late, so for a while after a
+			//    restart, the rate is measured from the least late callback
+			//    seen; one late start would bias the rate for a long time
+			if (wall - m_Restart < KK5JY_CLOCK_BASELINE) {
+				if (wall < m_RefTime + (static_cast<double>(m_Count - m_RefCount) / m_Fs)) {
+					m_RefTime = wall;
+					m_RefCount = m_Count;
+				}
+			}
+
+			// the rate, over as long a span as there is; the callback's
+			//    timing jitter shrinks in proportion
+			const double span = wall - m_RefTime;
+			if (span >= KK5JY_CLOCK_BASELINE)
+				m_Fs = static_cast<double>(m_Count - m_RefCount) / span;
+
+			// slew the time toward the wall clock
+			m_AnchorTime = predicted + (KK5JY_CLOCK_GAIN * m_Error);
+			m_AnchorCount = m_Count;
+		}
 	}
 }
 
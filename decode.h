@@ -18,18 +18,40 @@
 // C++ STL types
 #include <string>
 #include <deque>
+#include <set>
+#include <algorithm>
 
 // for popen(...) and file I/O
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <errno.h>
 
 // for WAV file interface
 #include "sf.h"
 
+// persistent 'jt9' backend; build with 'make JT9=shm'
+#include <vector>
+#include <stdint.h>
+#include "jt9shm.h"
+
+// in-process decoder; build with 'make DECODER=native'
+#ifdef KK5JY_NATIVE_DECODER
+#include "ft8native.h"
+#endif
+
+// both of the above take the samples from memory, not a WAV file
+#if defined(KK5JY_JT9_SHM) || defined(KK5JY_NATIVE_DECODER)
+#define KK5JY_DECODE_IN_MEMORY
+#endif
+
 // string operations
 #include "stype.h"
 
+// thread-safe line buffer
+#include "locker.h"
+#include "IDecodeSink.h"
+
 // clock operations
 #include "clock.h"
 
@@ -44,18 +66,44 @@
 
 namespace KK5JY {
 	namespace FT8 {
+		class DecodeBase;
+
 		// the worker thread
 		void *decoder_thread(void *parent);
 
+		// run 'jt9' for one decode (or one band of it), on the calling thread;
+		//    the native decoder may use up to 'threads' more (0 = one per CPU)
+		void decode_run(DecodeBase *decode, size_t band = 0, size_t threads = 0);
+
+		// mark a decode done (run or not) and tell its sink
+		void decode_finish(DecodeBase *decode);
+
+		//
+		//  struct DecodeBand - the audio frequency range of one decode job
+		//
+		struct DecodeBand {
+			int low;  // lowest signal frequency (Hz)
+			int high; // highest signal frequency (Hz)
+		};
+
+
 		//
 		//  class DecodeBase
 		//
-		class DecodeBase {
+		class DecodeBase : public IDecodeSink {
 			protected:
 				// common/shared data elements
 				std::string m_Mode;
 				std::string m_Path;
-				std::deque<std::string> m_Buffer;
+				std::deque<std::string> m_Buffer; // lines not yet fetched (no sink)
+				my::mutex m_BufferLock;
+				IDecodeSink *m_Sink; // where lines go as they arrive, if set
+				std::set<std::string> m_Seen; // messages already passed on
+				std::vector<DecodeBand> m_Bands; // empty means the whole passband
+				size_t m_Remaining; // bands not yet finished (scheduler only)
+				#ifdef KK5JY_DECODE_IN_MEMORY
+				std::vector<int16_t> m_Audio; // 12kHz samples for the decoder
+				#endif
 				double m_DecodeStartTime;
 				double m_CaptureStartTime;
 				size_t m_Samples;
@@ -66,13 +114,130 @@ namespace KK5JY {
 
 				// allow thread worker to access private data
 				friend void *decoder_thread(void *parent);
+				friend void decode_run(DecodeBase *decode, size_t band, size_t threads);
+				friend void decode_finish(DecodeBase *decode);
+				friend class DecodeScheduler;
 
 			public:
-				DecodeBase() : m_Depth(1), m_Done(false) { /* nop */ }
+				DecodeBase() : m_Sink(0), m_Remaining(0), m_Depth(1), m_Done(false) { /* nop */ }
 				virtual ~DecodeBase() { /* nop */ }
 
+				// pass one line from 'jt9' on to the sink, or buffer it;
+				//    a message already seen (from an overlapping band) is
+				//    dropped
+				void decoded(double start, const std::string &line);
+
 				double GetDecodeStart() const { return m_DecodeStartTime; }
 				double GetCaptureStart() const { return m_CaptureStartTime; }
+
+				// the decoding depth (1...3); may be lowered before the
+				//    decode starts, by the scheduler
+				short GetDepth() const { return m_Depth; }
+				void SetDepth(short depth) { m_Depth = depth; }
+
+				// split the decode into bands, each run as its own job
+				void SetBands(const std::vector<DecodeBand> &bands) { m_Bands = bands; }
+				size_t GetBands() const { return m_Bands.empty() ? 1 : m_Bands.size(); }
+
+				// returns true iff the decoder is finished
+				bool isDone() const volatile { return m_Done; }
+		};
+
+
+		// the scheduler worker threads
+		class DecodeScheduler;
+		void *scheduler_thread(void *parent);
+
+
+		// the passband split into sub-bands (Hz)
+		#ifndef KK5JY_DECODE_LOW
+		#define KK5JY_DECODE_LOW (200)
+		#endif
+		#ifndef KK5JY_DECODE_HIGH
+		#define KK5JY_DECODE_HIGH (3000)
+		#endif
+
+		//
+		//  class DecodeScheduler - a bounded queue of decode jobs, served by
+		//     a configurable number of worker threads; each slot may be
+		//     split into frequency sub-bands that decode concurrently
+		//
+		class DecodeScheduler {
+			public:
+				// what to do with a new slot when the queue is full
+				enum Policies {
+					DropOldest, // discard the oldest waiting slot
+					LowerDepth, // like DropOldest, but also decode at depth 1
+					            //    whenever slots are already waiting
+					Skip        // discard the new slot
+				};
+
+			private:
+				// one band of one slot
+				struct Job {
+					DecodeBase *decode;
+					size_t band;
+				};
+
+				std::deque<Job> m_Queue; // bands of a slot are kept together
+				size_t m_Capacity; // most slots waiting (not counting running)
+				size_t m_Bands;    // sub-bands per slot
+				int m_Overlap;     // sub-band overlap (Hz)
+				size_t m_Target;   // requested number of workers
+				size_t m_Workers;  // running worker threads
+				size_t m_Busy;     // workers currently decoding
+				Policies m_Policy;
+				bool m_Shutdown;
+				my::mutex m_Lock;
+				my::condition m_Ready;  // work queued, or workers changed
+				my::condition m_Exited; // a worker thread exited
+
+				// worker thread body
+				friend void *scheduler_thread(void *parent);
+				void worker();
+
+				// start workers until there are m_Target of them; locked
+				void spawn();
+
+				// the number of slots with bands waiting; locked
+				size_t waiting() const;
+
+				// remove the waiting bands of the oldest slot; returns the
+				//    slot if none of its bands are left running; locked
+				DecodeBase *dropOldest();
+
+			private: // disallowed
+				DecodeScheduler(const DecodeScheduler&);
+				DecodeScheduler &operator=(const DecodeScheduler&);
+
+			public:
+				DecodeScheduler(size_t workers = 2, size_t capacity = 4, Policies policy = LowerDepth);
+				~DecodeScheduler();
+
+				// queue a slot decode; returns false if it was discarded
+				//    instead (it is then already marked done)
+				bool submit(DecodeBase *job);
+
+				// split each slot into 'bands' sub-bands of equal width,
+				//    covering KK5JY_DECODE_LOW...KK5JY_DECODE_HIGH, each
+				//    widened by 'overlap' Hz at the inner edges
+				size_t setBands(size_t bands, int overlap = 25);
+				size_t getBands() const { return m_Bands; }
+
+				// the number of worker threads
+				size_t setWorkers(size_t workers);
+				size_t getWorkers() const { return m_Target; }
+
+				// the overload policy
+				Policies setPolicy(Policies policy) { return (m_Policy = policy); }
+				Policies getPolicy() const { return m_Policy; }
+
+				// the number of band jobs waiting for a worker
+				size_t pending();
+
+				// the CPUs each job may use: an even share among the jobs
+				//    that may run at once (workers times bands); locked
+				size_t jobThreads() const;
 		};
 
 
@@ -89,21 +254,24 @@ namespace KK5JY {
 					const std::string &mode,
 					const std::string &wav_path,
 					double start,
-					short depth = 2);
+					short depth = 2,
+					IDecodeSink *sink = 0);
 				virtual ~Decode();
 
 			public:
 				// add more WAV data to be decoded
 				size_t write(T* buffer, size_t count);
 
-				// close the WAV file and start the decoding process
-				bool startDecode();
+				// add more WAV data, already converted to 16-bit
+				size_t write(const int16_t* buffer, size_t count);
 
-				// copy the decodes into the buffer provided
-				size_t getDecodes(std::deque<std::string> &buffer);
+				// close the WAV file and start the decoding process, either
+				//    on a thread of its own or through 'scheduler'
+				bool startDecode(DecodeScheduler *scheduler = 0);
 
-				// returns true iff the decoder is finished
-				bool isDone() const volatile { return m_Done; }
+				// move the decodes received so far into the buffer provided;
+				//    only used when no sink was given to the ctor
+				size_t getDecodes(std::deque<std::string> &buffer);
 		};
 
 
@@ -112,9 +280,11 @@ namespace KK5JY {
 				const std::string &mode,
 				const std::string &wav_path,
 				double start,
-				short depth) {
+				short depth,
+				IDecodeSink *sink) {
 			// store the file name and start time
 			m_Mode = my::strip(my::toLower(mode));
+			m_Sink = sink;
 			m_Path = wav_path;
 			m_CaptureStartTime = start;
 			m_DecodeStartTime = 0;
@@ -123,11 +293,17 @@ namespace KK5JY {
 
 			std::cerr << "The mode is "<< m_Mode << std::endl;
 
+			#ifdef KK5JY_DECODE_IN_MEMORY
+			// samples stay in memory for the persistent or native decoder
+			m_WAV = 0;
+			m_Audio.reserve(15 * JT9_RATE);
+			#else
 			// open the sound file
 			m_WAV = new SoundFile(wav_path, JT9_RATE, 1,
                 SoundFile::major_formats::wav,
 				SoundFile::minor_formats::s16);
 			::chmod(wav_path.c_str(), 0600); // only owner can r/w the WAV file
+			#endif
 		}
 
 
@@ -144,6 +320,22 @@ namespace KK5JY {
 
 		template <typename T>
 		inline size_t Decode<T>::write(T* buffer, size_t count) {
+			#ifdef KK5JY_DECODE_IN_MEMORY
+			if (m_Done || m_DecodeStartTime != 0)
+				return 0;
+
+			// convert to 16-bit, the same way libsndfile does for the WAV file
+			m_Samples += count;
+			for (size_t i = 0; i != count; ++i) {
+				double s = buffer[i] * 32767.0;
+				if (s > 32767.0)
+					s = 32767.0;
+				else if (s < -32768.0)
+					s = -32768.0;
+				m_Audio.push_back(static_cast<int16_t>(::lrint(s)));
+			}
+			return count;
+			#else
 			// sanity checks
 			if (m_Done || ! m_WAV)
 				return 0;
@@ -153,23 +345,56 @@ namespace KK5JY {
 
 			// write data to the file
 			return m_WAV->write(buffer, count);
+			#endif
+		}
+
+
+		template <typename T>
+		inline size_t Decode<T>::write(const int16_t* buffer, size_t count) {
+			#ifdef KK5JY_DECODE_IN_MEMORY
+			if (m_Done || m_DecodeStartTime != 0)
+				return 0;
+			m_Samples += count;
+			m_Audio.insert(m_Audio.end(), buffer, buffer + count);
+			return count;
+			#else
+			// sanity checks
+			if (m_Done || ! m_WAV)
+				return 0;
+
+			// update the sample counter
+			m_Samples += count;
+
+			// write data to the file
+			return m_WAV->write(const_cast<short*>(buffer), count);
+			#endif
 		}
 
 
 		template <typename T>
-		inline bool Decode<T>::startDecode() {
+		inline bool Decode<T>::startDecode(DecodeScheduler *scheduler) {
+			#ifdef KK5JY_DECODE_IN_MEMORY
+			if (m_DecodeStartTime != 0) {
+				return false;
+			}
+			#else
 			if ( ! m_WAV) {
 				return false;
 			}
+			#endif
 
 			m_DecodeStartTime = abstime();
 
-			// pad the WAV file if needed to make them all the same length
+			// pad the capture if needed to make them all the same length
 			size_t full_frame = 0;
 			if (m_Mode == "ft8")
 				full_frame = 13.5 * JT9_RATE;
 			else if (m_Mode == "ft4")
 				full_frame = 6.5 * JT9_RATE;
+			#ifdef KK5JY_DECODE_IN_MEMORY
+			if (m_Audio.size() < full_frame)
+				m_Audio.resize(full_frame, 0);
+			#else
 			for (size_t i = m_Samples; i < full_frame; ++i) {
 				T sample = 0;
 				m_WAV->write(sample);
@@ -180,8 +405,13 @@ namespace KK5JY {
 			toDelete->close();
 			delete toDelete;
 			m_WAV = 0;
+			#endif
 			m_Samples = 0;
 
+			// queue the job
+			if (scheduler)
+				return scheduler->submit(this);
+
 			// build new thread attributes
 			::pthread_attr_t attrs;
 			pthread_attr_init(&attrs);
@@ -196,10 +426,29 @@ namespace KK5JY {
 		}
 
 
+		//
+		//  DecodeBase::decoded(...)
+		//
+		inline void DecodeBase::decoded(double start, const std::string &line) {
+			// the message text follows the '~' (FT8) or '+' (FT4) marker;
+			//    the SNR, DT and frequency before it differ between bands
+			std::string::size_type idx = line.find_first_of("~+", 7);
+			std::string key = (idx == std::string::npos) ? line : my::strip(line.substr(idx + 1));
+
+			my::locker lock(m_BufferLock);
+			if ( ! m_Seen.insert(key).second)
+				return;
+			if (m_Sink) {
+				m_Sink->decoded(start, line);
+				return;
+			}
+			m_Buffer.push_back(line);
+		}
+
+
 		template <typename T>
 		inline size_t Decode<T>::getDecodes(std::deque<std::string> &buffer) {
-			if ( ! m_Done)
-				return 0;
+			my::locker lock(m_BufferLock);
 
 			// copy from our buffer into the caller's
 			size_t result = 0;
@@ -218,28 +467,164 @@ namespace KK5JY {
 
 
 		//
-		//  the worker thread
+		//  decode_line(...) - pass one line of 'jt9' output to the decoder,
+		//     if it is a decode (those start with the time of the slot)
 		//
-		inline void *decoder_thread(void *parent) {
+		inline void decode_line(DecodeBase *decode, const std::string &raw) {
+			std::string line = my::strip(raw);
+			if (line.size() > 1 && isdigit(line[0]) && isdigit(line[1]))
+				decode->decoded(decode->GetCaptureStart(), line);
+		}
 
-			std::cerr << "Starting decoder thread..." << std::endl;
 
+		#ifndef KK5JY_DECODE_IN_MEMORY
+		//
+		//  class Jt9Folders - work folders for 'jt9' runs that overlap;
+		//     each run writes decoded.txt, timer.out and its FFTW wisdom
+		//     where it runs, so runs at the same time must not share one.
+		//     The first run uses the current folder, as always; others
+		//     get a private folder, kept for reuse (and the wisdom in it)
+		//     until exit.
+		//
+		class Jt9Folders {
+			private:
+				my::mutex m_Lock;
+				std::vector<std::string> m_Paths; // [0] is the current folder
+				std::vector<bool> m_Busy;
 
-			DecodeBase *decode = reinterpret_cast<DecodeBase*>(parent);
-			if ( ! decode)
-				pthread_exit(0);
+			public:
+				Jt9Folders() : m_Paths(1), m_Busy(1, false) { /* nop */ }
+				~Jt9Folders();
+
+			public:
+				// claim a folder; sets 'path' ("" for the current folder)
+				size_t acquire(std::string &path);
+
+				// return a folder from acquire()
+				void release(size_t index);
+
+				// the one instance
+				static Jt9Folders &get() { static Jt9Folders theFolders; return theFolders; }
+
+			public:
+				// a folder, held for the life of the object
+				struct Lease {
+					std::string path;
+					size_t index;
+
+					Lease() { index = get().acquire(path); }
+					~Lease() { get().release(index); }
+				};
+		};
+
+
+		//
+		//  Jt9Folders::acquire(...)
+		//
+		inline size_t Jt9Folders::acquire(std::string &path) {
+			my::locker lock(m_Lock);
+			size_t i = 0;
+			while (i != m_Busy.size() && m_Busy[i])
+				++i;
+			if (i == m_Busy.size()) {
+				std::string tmpl = jt9_temp_path() + "/ft8modem.XXXXXX";
+				std::vector<char> buf(tmpl.begin(), tmpl.end());
+				buf.push_back(0);
+				if ( ! ::mkdtemp(&buf[0]))
+					throw std::runtime_error("Could not create jt9 work folder");
+				m_Paths.push_back(&buf[0]);
+				m_Busy.push_back(false);
+			}
+			m_Busy[i] = true;
+			path = m_Paths[i];
+			return i;
+		}
+
+
+		//
+		//  Jt9Folders::release(...)
+		//
+		inline void Jt9Folders::release(size_t index) {
+			my::locker lock(m_Lock);
+			if (index < m_Busy.size())
+				m_Busy[index] = false;
+		}
+
+
+		//
+		//  Jt9Folders::dtor - remove the private folders and their contents
+		//
+		inline Jt9Folders::~Jt9Folders() {
+			for (size_t i = 1; i < m_Paths.size(); ++i) {
+				DIR *dir = ::opendir(m_Paths[i].c_str());
+				if (dir) {
+					struct dirent *ent;
+					while ((ent = ::readdir(dir)) != 0) {
+						std::string name = ent->d_name;
+						if (name != "." && name != "..")
+							::unlink((m_Paths[i] + "/" + name).c_str());
+					}
+					::closedir(dir);
+				}
+				::rmdir(m_Paths[i].c_str());
+			}
+		}
+		#endif
+
+
+		//
+		//  decode_run(...) - run 'jt9' (or the native decoder) for one decode
+		//
+		inline void decode_run(DecodeBase *decode, size_t band, size_t threads) {
+			// frequency limits; zero lets 'jt9' use its defaults
+			int low = 0, high = 0;
+			if (band < decode->m_Bands.size()) {
+				low = decode->m_Bands[band].low;
+				high = decode->m_Bands[band].high;
+			}
 
 			try {
+				#if defined(KK5JY_NATIVE_DECODER)
+				// decode in-process
+				native_decode(
+						decode->m_Mode, decode->m_Depth, decode->m_CaptureStartTime,
+						decode->m_Audio.empty() ? 0 : &decode->m_Audio[0],
+						decode->m_Audio.size(), *decode, low, high, threads);
+				#elif defined(KK5JY_JT9_SHM)
+				// hand the samples to an idle persistent jt9
+				Jt9Server *server = Jt9Server::acquire();
+				bool ok = server->decode(
+						decode->m_Mode, decode->m_Depth, decode->m_CaptureStartTime,
+						decode->m_Audio.empty() ? 0 : &decode->m_Audio[0],
+						decode->m_Audio.size(), *decode, low, high);
+				Jt9Server::release(server);
+				if ( ! ok) {
+					std::cerr << "ERR: Persistent jt9 decode failed" << std::endl;
+				}
+				#else
 				std::cerr << "Recorded audio file is " << decode->m_Path << std::endl;
 
-				// start 'jt9' on the temp file
-				std::string cmd = "jt9";
+				// a folder of its own, if another 'jt9' is running
+				Jt9Folders::Lease folder;
+
+				// start 'jt9' on the temp file; jt9 is Fortran, so keep its
+				//    stdout from being block-buffered
+				std::string cmd = "GFORTRAN_UNBUFFERED_PRECONNECTED=y ";
+				cmd += jt9_binary();
 				if (decode->m_Mode == "ft8")
 					cmd += " --ft8 ";
 				else
 					cmd += " --ft4 ";
 				cmd += " -d ";
 				cmd += (char)(decode->m_Depth + '0');
+				if (high > low) {
+					cmd += " -L " + std::to_string(low);
+					cmd += " -H " + std::to_string(high);
+				}
+				if ( ! folder.path.empty()) {
+					cmd += " -a " + folder.path;
+					cmd += " -t " + folder.path;
+				}
 				cmd += ' ';
 				cmd += decode->m_Path;
 				FILE *jt9 = popen(cmd.c_str(), "r");
@@ -250,51 +635,329 @@ namespace KK5JY {
 					std::cerr << "JT9 started" << std::endl;
 				//#endif
 
-				// I/O loop on 'jt9' output
-				char iobuffer[128];
+				// I/O loop on 'jt9' output; read() returns whatever the pipe
+				//    holds, so each line is passed on as soon as it is printed
+				char iobuffer[512];
 				std::string linebuffer;
-				while ( ! feof(jt9)) {
-					int ct = fread(iobuffer, 1, 128, jt9);
+				while (jt9) {
+					ssize_t ct = ::read(fileno(jt9), iobuffer, sizeof(iobuffer));
+					if (ct < 0 && errno == EINTR)
+						continue;
 					if (ct <= 0)
 						break;
 
+					#ifdef VERBOSE_DEBUG
 					std::cerr << "JT9 sent (" << ct << ") bytes" << std::endl;
+					#endif
 
-					// process the new data
+					// process the new data; erase consumed lines once per read
 					linebuffer.append(iobuffer, ct);
-					std::string::size_type idx = linebuffer.find('\n');
-					while (idx != std::string::npos) {
-						std::string line = my::strip(linebuffer.substr(0, idx));
-						if (isdigit(line[0]) && isdigit(line[1]))
-							decode->m_Buffer.push_back(line);
-						linebuffer = linebuffer.substr(idx + 1);
-						idx = linebuffer.find('\n');
+					std::string::size_type pos = 0, idx;
+					while ((idx = linebuffer.find('\n', pos)) != std::string::npos) {
+						decode_line(decode, linebuffer.substr(pos, idx - pos));
+						pos = idx + 1;
 					}
+					linebuffer.erase(0, pos);
 				}
 
 				// close the pipe to the child
-				fclose(jt9);
-
-				// make sure to include remainder
-				std::string::size_type idx = linebuffer.find('\n');
-				while (idx != std::string::npos) {
-					std::string line = my::strip(linebuffer.substr(0, idx));
-					if (isdigit(line[0]) && isdigit(line[1]))
-						decode->m_Buffer.push_back(line);
-					linebuffer = linebuffer.substr(idx + 1);
-					idx = linebuffer.find('\n');
-				}
+				if (jt9)
+					pclose(jt9);
+
+				// make sure to include an unterminated last line
+				decode_line(decode, linebuffer);
+				#endif
 			} catch (const std::exception &ex) {
 				std::cerr << "caught exception: " << ex.what() << std::endl;
 			}
+		}
 
-			std::cerr << "Decode thread complete" << std::endl;
 
-			// all done
+		//
+		//  decode_finish(...) - release the decode to its owner
+		//
+		inline void decode_finish(DecodeBase *decode) {
+			#ifndef KK5JY_DECODE_IN_MEMORY
 			unlink(decode->m_Path.c_str());
+			#endif
+
+			// the owner may delete 'decode' as soon as m_Done is set
+			IDecodeSink *sink = decode->m_Sink;
+			double start = decode->m_CaptureStartTime;
 			decode->m_Done = true;
+			if (sink)
+				sink->finished(start);
+		}
+
+
+		//
+		//  the worker thread
+		//
+		inline void *decoder_thread(void *parent) {
+
+			std::cerr << "Starting decoder thread..." << std::endl;
+
+
+			DecodeBase *decode = reinterpret_cast<DecodeBase*>(parent);
+			if ( ! decode)
+				pthread_exit(0);
+
+			decode_run(decode);
+
+			std::cerr << "Decode thread complete" << std::endl;
+
+			// all done
+			decode_finish(decode);
 			pthread_exit(0);
 		}
+
+
+		//
+		//  DecodeScheduler::ctor
+		//
+		inline DecodeScheduler::DecodeScheduler(size_t workers, size_t capacity, Policies policy)
+			: m_Capacity(capacity ? capacity : 1), m_Bands(1), m_Overlap(25),
+			  m_Target(workers ? workers : 1),
+			  m_Workers(0), m_Busy(0), m_Policy(policy), m_Shutdown(false) {
+			my::locker lock(m_Lock);
+			spawn();
+		}
+
+
+		//
+		//  DecodeScheduler::dtor - waits for running decodes; waiting ones
+		//     are discarded
+		//
+		inline DecodeScheduler::~DecodeScheduler() {
+			std::vector<DecodeBase*> dropped;
+			{
+				my::locker lock(m_Lock);
+				m_Shutdown = true;
+				while ( ! m_Queue.empty()) {
+					DecodeBase *slot = dropOldest();
+					if (slot)
+						dropped.push_back(slot);
+				}
+				m_Ready.broadcast();
+				while (m_Workers)
+					m_Exited.wait(m_Lock);
+			}
+			for (size_t i = 0; i != dropped.size(); ++i)
+				decode_finish(dropped[i]);
+		}
+
+
+		//
+		//  scheduler_thread(...) - scheduler worker entry point
+		//
+		inline void *scheduler_thread(void *parent) {
+			DecodeScheduler *sched = reinterpret_cast<DecodeScheduler*>(parent);
+			if (sched)
+				sched->worker();
+			return 0;
+		}
+
+
+		//
+		//  DecodeScheduler::spawn()
+		//
+		inline void DecodeScheduler::spawn() {
+			::pthread_attr_t attrs;
+			pthread_attr_init(&attrs);
+			pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+			while (m_Workers < m_Target) {
+				pthread_t id;
+				if (pthread_create(&id, &attrs, scheduler_thread, this) != 0) {
+					std::cerr << "ERR: Could not start decode worker" << std::endl;
+					break;
+				}
+				++m_Workers;
+			}
+			pthread_attr_destroy(&attrs);
+		}
+
+
+		//
+		//  DecodeScheduler::waiting()
+		//
+		inline size_t DecodeScheduler::waiting() const {
+			size_t result = 0;
+			DecodeBase *last = 0;
+			std::deque<Job>::const_iterator i;
+			for (i = m_Queue.begin(); i != m_Queue.end(); ++i) {
+				if (i->decode != last)
+					++result;
+				last = i->decode;
+			}
+			return result;
+		}
+
+
+		//
+		//  DecodeScheduler::dropOldest()
+		//
+		inline DecodeBase *DecodeScheduler::dropOldest() {
+			if (m_Queue.empty())
+				return 0;
+			DecodeBase *slot = m_Queue.front().decode;
+			while ( ! m_Queue.empty() && m_Queue.front().decode == slot) {
+				m_Queue.pop_front();
+				--slot->m_Remaining;
+			}
+			return slot->m_Remaining ? 0 : slot;
+		}
+
+
+		//
+		//  DecodeScheduler::jobThreads()
+		//
+		inline size_t DecodeScheduler::jobThreads() const {
+			long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+			const size_t jobs = std::max<size_t>(m_Target, 1) * std::max<size_t>(m_Bands, 1);
+			if (cpus <= 0 || static_cast<size_t>(cpus) <= jobs)
+				return 1;
+			return static_cast<size_t>(cpus) / jobs;
+		}
+
+
+		//
+		//  DecodeScheduler::worker()
+		//
+		inline void DecodeScheduler::worker() {
+			my::locker lock(m_Lock);
+			while (true) {
+				// exit on shutdown, or when there are too many workers
+				if (m_Shutdown || m_Workers > m_Target)
+					break;
+				if (m_Queue.empty()) {
+					m_Ready.wait(m_Lock);
+					continue;
+				}
+
+				Job job = m_Queue.front();
+				m_Queue.pop_front();
+				++m_Busy;
+				const size_t threads = jobThreads();
+
+				// decode without holding the lock
+				m_Lock.unlock();
+				decode_run(job.decode, job.band, threads);
+				m_Lock.lock();
+
+				// the last band to finish completes the slot
+				--m_Busy;
+				if (--job.decode->m_Remaining == 0) {
+					m_Lock.unlock();
+					decode_finish(job.decode);
+					m_Lock.lock();
+				}
+			}
+			--m_Workers;
+			m_Exited.broadcast();
+		}
+
+
+		//
+		//  DecodeScheduler::submit(...)
+		//
+		inline bool DecodeScheduler::submit(DecodeBase *job) {
+			if ( ! job)
+				return false;
+
+			DecodeBase *dropped = 0;
+			bool accepted = true;
+			{
+				my::locker lock(m_Lock);
+				if (m_Shutdown) {
+					dropped = job;
+					accepted = false;
+				} else {
+					// falling behind; trade depth for speed
+					if (m_Policy == LowerDepth && job->GetDepth() > 1 &&
+							( ! m_Queue.empty() || m_Busy >= m_Target)) {
+						std::cerr << "WARN: Decoder busy; decoding at depth 1" << std::endl;
+						job->SetDepth(1);
+					}
+
+					if (waiting() >= m_Capacity) {
+						if (m_Policy == Skip) {
+							dropped = job;
+							accepted = false;
+						} else {
+							dropped = dropOldest();
+						}
+					}
+					if (accepted) {
+						// split into sub-bands
+						if (m_Bands > 1) {
+							std::vector<DecodeBand> bands(m_Bands);
+							double width = double(KK5JY_DECODE_HIGH - KK5JY_DECODE_LOW) / m_Bands;
+							for (size_t i = 0; i != m_Bands; ++i) {
+								bands[i].low = KK5JY_DECODE_LOW + static_cast<int>(i * width);
+								bands[i].high = KK5JY_DECODE_LOW + static_cast<int>((i + 1) * width);
+								if (i != 0)
+									bands[i].low -= m_Overlap;
+								if (i + 1 != m_Bands)
+									bands[i].high += m_Overlap;
+							}
+							job->SetBands(bands);
+						}
+
+						job->m_Remaining = job->GetBands();
+						for (size_t i = 0; i != job->m_Remaining; ++i) {
+							Job item = { job, i };
+							m_Queue.push_back(item);
+						}
+						m_Ready.broadcast();
+					}
+				}
+			}
+
+			// release a discarded slot outside the lock
+			if (dropped) {
+				std::cerr << "WARN: Decode queue full; slot dropped" << std::endl;
+				decode_finish(dropped);
+			}
+			return accepted;
+		}
+
+
+		//
+		//  DecodeScheduler::setWorkers(...)
+		//
+		inline size_t DecodeScheduler::setWorkers(size_t workers) {
+			if ( ! workers)
+				return m_Target;
+			my::locker lock(m_Lock);
+			m_Target = workers;
+			spawn();
+
+			// extra workers exit when they wake up
+			m_Ready.broadcast();
+			return m_Target;
+		}
+
+
+		//
+		//  DecodeScheduler::setBands(...)
+		//
+		inline size_t DecodeScheduler::setBands(size_t bands, int overlap) {
+			if ( ! bands)
+				return m_Bands;
+			my::locker lock(m_Lock);
+			m_Bands = bands;
+			m_Overlap = overlap < 0 ? 0 : overlap;
+			return m_Bands;
+		}
+
+
+		//
+		//  DecodeScheduler::pending()
+		//
+		inline size_t DecodeScheduler::pending() {
+			my::locker lock(m_Lock);
+			return m_Queue.size();
+		}
 	}
 }
 
@@ -0,0 +1,240 @@
+/*
+ *
+ *
+ *    decodelog.h
+ *
+ *    Fixed-size log of decoded messages.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    A ring of records allocated once, written by one thread (the
+ *    decoder) and read by any number of others without a lock.  Each
+ *    record has its own sequence lock: the writer makes its version odd
+ *    while changing it, and a reader copies the record and tries again
+ *    if the version was odd or changed under it.  Readers never hold up
+ *    the writer, and the memory used doesn't grow.
+ *
+ */
+
+#ifndef __KK5JY_DECODELOG_H
+#define __KK5JY_DECODELOG_H
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+#include "snddev.h"
+
+// the longest decoded line kept (characters)
+#ifndef KK5JY_DECODED_TEXT
+#define KK5JY_DECODED_TEXT (128)
+#endif
+
+namespace KK5JY {
+	namespace FT8 {
+		//
+		//  class DecodedLog
+		//
+		class DecodedLog {
+			private:
+				// one decoded message, as stored
+				struct Record {
+					uint64_t position; // which write this is; tells laps apart
+					uint64_t sequence;
+					long time;
+					bool early;
+					char content[KK5JY_DECODED_TEXT];
+				};
+
+				// a record and its sequence lock
+				struct Slot {
+					std::atomic<uint64_t> version; // odd while being written
+					Record record;
+
+					Slot() : version(0) { std::memset(&record, 0, sizeof(record)); }
+				};
+
+			private:
+				size_t m_Capacity;
+				Slot *m_Slots;
+				std::atomic<uint64_t> m_Head;     // number of records written
+				std::atomic<uint64_t> m_Base;     // first record not wiped
+				std::atomic<uint64_t> m_Sequence; // newest sequence number given
+
+			private: // disallowed
+				DecodedLog(const DecodedLog&);
+				DecodedLog &operator=(const DecodedLog&);
+
+			private:
+				// store 'line' in 'slot' (writer only)
+				void store(Slot &slot, uint64_t position, uint64_t sequence, const DecodedLine &line);
+
+				// copy 'slot' consistently (any thread)
+				void load(const Slot &slot, Record &out) const;
+
+			public:
+				DecodedLog(size_t capacity);
+				~DecodedLog() { delete [] m_Slots; }
+
+			public:
+				// add a new message, replacing the oldest once full, and
+				//    return its sequence number (writer only)
+				uint64_t add(const DecodedLine &line);
+
+				// find the message from the slot of 'line' with the same
+				//    text, and return its sequence number, or 0; 'early' is
+				//    set if it came from the early pass (writer only)
+				uint64_t find(const DecodedLine &line, bool &early) const;
+
+				// replace the message numbered 'sequence' with 'line', which
+				//    is given the next number, so LOGS SINCE returns it
+				//    again; returns the new number, or 0 (writer only)
+				uint64_t replace(uint64_t sequence, const DecodedLine &line);
+
+				// hide all the messages written so far (any thread)
+				void wipe() { m_Base.store(m_Head.load(std::memory_order_acquire), std::memory_order_release); }
+
+				// copy the messages numbered after 'since', newest first,
+				//    and return the newest number given (any thread)
+				uint64_t snapshot(std::vector<DecodedLine> &out, uint64_t since = 0) const;
+
+				// the newest sequence number given (any thread)
+				uint64_t sequence() const { return m_Sequence.load(std::memory_order_acquire); }
+
+				// the most messages kept
+				size_t capacity() const { return m_Capacity; }
+		};
+
+
+		//
+		//  DecodedLog::DecodedLog
+		//
+		inline DecodedLog::DecodedLog(size_t capacity)
+			: m_Capacity(capacity ? capacity : 1), m_Head(0), m_Base(0), m_Sequence(0) {
+			m_Slots = new Slot[m_Capacity];
+		}
+
+
+		//
+		//  DecodedLog::store(...)
+		//
+		inline void DecodedLog::store(Slot &slot, uint64_t position, uint64_t sequence, const DecodedLine &line) {
+			const uint64_t v = slot.version.load(std::memory_order_relaxed);
+			slot.version.store(v + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			Record &r = slot.record;
+			r.position = position;
+			r.sequence = sequence;
+			r.time = line.getTime();
+			r.early = line.isEarly();
+			const std::string content = line.getContent();
+			const size_t len = std::min(content.size(), sizeof(r.content) - 1);
+			std::memcpy(r.content, content.data(), len);
+			r.content[len] = '\0';
+
+			slot.version.store(v + 2, std::memory_order_release);
+		}
+
+
+		//
+		//  DecodedLog::load(...)
+		//
+		inline void DecodedLog::load(const Slot &slot, Record &out) const {
+			while (true) {
+				const uint64_t v1 = slot.version.load(std::memory_order_acquire);
+				if (v1 & 1)
+					continue; // being written
+				std::memcpy(&out, &slot.record, sizeof(out));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.version.load(std::memory_order_relaxed) == v1)
+					return;
+			}
+		}
+
+
+		//
+		//  DecodedLog::add(...)
+		//
+		inline uint64_t DecodedLog::add(const DecodedLine &line) {
+			const uint64_t position = m_Head.load(std::memory_order_relaxed);
+			const uint64_t sequence = m_Sequence.load(std::memory_order_relaxed) + 1;
+			store(m_Slots[position % m_Capacity], position, sequence, line);
+			m_Head.store(position + 1, std::memory_order_release);
+			m_Sequence.store(sequence, std::memory_order_release);
+			return sequence;
+		}
+
+
+		//
+		//  DecodedLog::find(...)
+		//
+		inline uint64_t DecodedLog::find(const DecodedLine &line, bool &early) const {
+			const uint64_t head = m_Head.load(std::memory_order_relaxed);
+			const uint64_t base = m_Base.load(std::memory_order_acquire);
+			const std::string message = line.getMessage();
+			for (uint64_t p = head; p > base && head - p < m_Capacity; --p) {
+				const Record &r = m_Slots[(p - 1) % m_Capacity].record;
+				if (r.time == line.getTime() && DecodedLine(r.time, r.content).getMessage() == message) {
+					early = r.early;
+					return r.sequence;
+				}
+			}
+			return 0;
+		}
+
+
+		//
+		//  DecodedLog::replace(...)
+		//
+		inline uint64_t DecodedLog::replace(uint64_t sequence, const DecodedLine &line) {
+			const uint64_t head = m_Head.load(std::memory_order_relaxed);
+			for (uint64_t p = head; p > 0 && head - p < m_Capacity; --p) {
+				Slot &slot = m_Slots[(p - 1) % m_Capacity];
+				if (slot.record.sequence == sequence) {
+					const uint64_t next = m_Sequence.load(std::memory_order_relaxed) + 1;
+					store(slot, p - 1, next, line);
+					m_Sequence.store(next, std::memory_order_release);
+					return next;
+				}
+			}
+			return 0;
+		}
+
+
+		//
+		//  DecodedLog::snapshot(...)
+		//
+		inline uint64_t DecodedLog::snapshot(std::vector<DecodedLine> &out, uint64_t since) const {
+			// read the newest number first; every record up to it is written
+			const uint64_t newest = m_Sequence.load(std::memory_order_acquire);
+			const uint64_t head = m_Head.load(std::memory_order_acquire);
+			const uint64_t base = m_Base.load(std::memory_order_acquire);
+
+			out.clear();
+			out.reserve(m_Capacity);
+			Record r;
+			for (uint64_t p = head; p > base && head - p < m_Capacity; --p) {
+				load(m_Slots[(p - 1) % m_Capacity], r);
+				if (r.position != p - 1)
+					break; // overwritten since; the rest are older still
+				if (r.sequence > newest)
+					continue; // added after 'newest' was read
+				if (r.sequence <= since)
+					continue; // a replaced record is numbered out of order
+				DecodedLine line(r.time, r.content, r.early);
+				line.setSequence(r.sequence);
+				out.push_back(line);
+			}
+			return newest;
+		}
+	}
+}
+
+#endif // __KK5JY_DECODELOG_H
+
+// EOF
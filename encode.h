@@ -9,69 +9,98 @@
  *    License: GNU GPL3 (www.gnu.org)
  *
  *
+ *    Does in-process what 'ft8code' and 'ft4code' do: pack the message
+ *    into 77 bits, add the CRC and LDPC parity, and map the codeword to
+ *    tones between the Costas sync arrays.
+ *
  */
 
-#include <stdio.h>
+#ifndef __KK5JY_FT8_ENCODE_H
+#define __KK5JY_FT8_ENCODE_H
+
 #include <string>
 #include <stdexcept>
+#include <stdint.h>
 #include "stype.h"
+#include "ft8ldpc.h"
+#include "ft8msg.h"
 
 namespace KK5JY {
 	namespace FT8 {
+		// the FT8 and FT4 symbol patterns
+		static const uint8_t FT8_COSTAS[7] = { 3, 1, 4, 0, 6, 5, 2 };
+		static const uint8_t FT8_GRAY[8] = { 0, 1, 3, 2, 5, 6, 4, 7 };
+		static const uint8_t FT4_COSTAS[4][4] = {
+			{ 0, 1, 3, 2 }, { 1, 0, 2, 3 }, { 2, 3, 1, 0 }, { 3, 2, 0, 1 }
+		};
+		static const uint8_t FT4_GRAY[4] = { 0, 1, 3, 2 };
+
+		// FT4 scrambles the payload, to avoid long runs of one tone
+		static const uint8_t FT4_XOR[10] = {
+			0x4A, 0x5E, 0x89, 0xB4, 0xB0, 0x8A, 0x79, 0x55, 0xBE, 0x28
+		};
+
+
 		//
-		//  return the keying symbols for a message
+		//  return the keying symbols for a message: 79 digits for FT8,
+		//     103 for FT4; empty if the message can't be packed
 		//
 		inline std::string encode(const std::string &mode, const std::string &txt) {
-			std::string tool;
 			std::string rmode = my::toLower(mode);
-			if (rmode == "ft8") {
-				tool = "ft8code";
-			} else if (rmode == "ft4") {
-				tool = "ft4code";
-			} else {
+			if (rmode != "ft8" && rmode != "ft4") {
 				throw std::runtime_error("Invalid mode provided");
 			}
+			const bool ft4 = (rmode == "ft4");
 
-			// use 'ft[48]code' to generate the message symbols
-			std::string cmd = tool + " \"" + txt + "\" | tail -1";
-			FILE *code = popen(cmd.c_str(), "r");
-
-			#ifdef VERBOSE_DEBUG
-			std::cerr << "popen(" << cmd << ")" << std::endl;
-			#endif
-
-			if ( ! code) {
-				#ifdef VERBOSE_DEBUG
-				std::cerr << "ft8code failed" << std::endl;
-				#endif
-
-				// return failure
+			// message, CRC and parity
+			uint8_t payload[10];
+			if ( ! pack77(txt, payload))
 				return "";
+			if (ft4) {
+				for (int i = 0; i != 10; ++i)
+					payload[i] ^= FT4_XOR[i];
 			}
+			uint8_t a91[12];
+			ft8_add_crc(payload, a91);
+			uint8_t codeword[LDPC_N];
+			ldpc_encode(a91, codeword);
 
-			// I/O loop on 'ft8code' output
-			char iobuffer[128];
-			std::string linebuffer;
-			while ( ! feof(code)) {
-				size_t ct = fread(iobuffer, 1, sizeof(iobuffer), code);
-				linebuffer.append(iobuffer, ct);
-				if (ct == 0)
-					break;
+			std::string result;
+			if (ft4) {
+				// S D29 S D29 S D29 S, two bits per symbol
+				result.reserve(103);
+				for (int block = 0; block != 4; ++block) {
+					for (int i = 0; i != 4; ++i)
+						result += static_cast<char>('0' + FT4_COSTAS[block][i]);
+					if (block == 3)
+						break;
+					for (int k = block * 29; k != (block + 1) * 29; ++k)
+						result += static_cast<char>('0' + FT4_GRAY[(codeword[2 * k] << 1) | codeword[(2 * k) + 1]]);
+				}
+			} else {
+				// S D29 S D29 S, three bits per symbol
+				result.reserve(79);
+				for (int block = 0; block != 3; ++block) {
+					for (int i = 0; i != 7; ++i)
+						result += static_cast<char>('0' + FT8_COSTAS[i]);
+					if (block == 2)
+						break;
+					for (int k = block * 29; k != (block + 1) * 29; ++k) {
+						const int value = (codeword[3 * k] << 2) | (codeword[(3 * k) + 1] << 1) | codeword[(3 * k) + 2];
+						result += static_cast<char>('0' + FT8_GRAY[value]);
+					}
+				}
 			}
 
-			// close the pipe to the child
-			fclose(code);
-
-			// trim the string
-			linebuffer = my::strip(linebuffer);
-
 			#ifdef VERBOSE_DEBUG
-			std::cerr << "ft8code returned: " << linebuffer << std::endl;
+			std::cerr << "encode(" << txt << ") returned: " << result << std::endl;
 			#endif
 
-			return linebuffer;
+			return result;
 		}
 	}
 }
 
+#endif // __KK5JY_FT8_ENCODE_H
+
 // EOF
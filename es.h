@@ -95,6 +95,8 @@ namespace KK5JY {
 			public:
 				Smoother(double alpha, T seed = 0);
 				T run(T in);
+				using IFilter<T>::process;
+				void process(const T *in, T *out, size_t count);
 				void clear(void);
 				T value() const { return state; }
 				void add(T s) { run(s); }
@@ -158,6 +160,16 @@ namespace KK5JY {
 				((static_cast<int64_t>(state) * (norm_limits<int32_t>::maximum - Alpha)) >> 31);
 		}
 
+		//
+		//  Smoother::process
+		//
+		template <typename T>
+		inline void Smoother<T>::process(const T *in, T *out, size_t count) {
+			for (size_t i = 0; i != count; ++i) {
+				out[i] = Smoother<T>::run(in[i]);
+			}
+		}
+
 		//
 		//  Smoother::clear
 		//
@@ -183,6 +195,8 @@ namespace KK5JY {
 			public:
 				Desmoother(double alpha, T seed = 0);
 				T run(T in);
+				using IFilter<T>::process;
+				void process(const T *in, T *out, size_t count);
 				void clear();
 				void add(T s) { run(s); }
 				T value() const { return y1; }
@@ -250,6 +264,16 @@ namespace KK5JY {
 			return y1;
 		}
 
+		//
+		//  Desmoother::process
+		//
+		template <typename T>
+		inline void Desmoother<T>::process(const T *in, T *out, size_t count) {
+			for (size_t i = 0; i != count; ++i) {
+				out[i] = Desmoother<T>::run(in[i]);
+			}
+		}
+
 		//
 		//  Desmoother::clera
 		//
@@ -276,6 +300,8 @@ namespace KK5JY {
 				Decay(double alpha, T seed = 0);
 
 				T run(T in);
+				using IFilter<T>::process;
+				void process(const T *in, T *out, size_t count);
 				T value() const { return state; }
 				void add(T in) { run(in); }
 				void clear();
@@ -337,6 +363,16 @@ namespace KK5JY {
 				((static_cast<int64_t>(state) * (norm_limits<int32_t>::maximum - Alpha)) >> 31);
 		}
 
+		//
+		//  Decay::process
+		//
+		template <typename T>
+		inline void Decay<T>::process(const T *in, T *out, size_t count) {
+			for (size_t i = 0; i != count; ++i) {
+				out[i] = Decay<T>::run(in[i]);
+			}
+		}
+
 		//
 		//  Decay::clear
 		//
@@ -0,0 +1,106 @@
+/*
+ *
+ *
+ *    fake_jt9.cc
+ *
+ *    Stand-in for 'jt9 -s' used to test the persistent decoder backend.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    Speaks the same shared memory and lock file protocol as 'jt9 -s', but
+ *    instead of decoding, prints one line per pass describing what it was
+ *    given.  If FAKE_JT9_LINES names a file, its lines are printed instead;
+ *    FAKE_JT9_DELAY adds a decoding delay in milliseconds.
+ *
+ *    Run a test with:  KK5JY_JT9=./fake_jt9 ./test_decode <wav>
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "jt9shm.h"
+
+using namespace KK5JY::FT8;
+using namespace std;
+
+int main(int argc, char**argv) {
+	std::string key, dir;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:t:a:w:m:e:")) != -1) {
+		switch (opt) {
+			case 's': key = optarg; break;
+			case 't': dir = optarg; break;
+			default: break; // accepted and ignored, like jt9's tuning options
+		}
+	}
+	if (key.empty() || dir.empty()) {
+		cerr << "Usage: " << argv[0] << " -s <key> -t <temp dir> [-a <dir>] [-w n] [-m n]" << endl;
+		return 1;
+	}
+
+	Jt9SharedMemory shm;
+	try {
+		shm.attach(key);
+	} catch (const std::exception &ex) {
+		cerr << "fake_jt9: " << ex.what() << endl;
+		return 1;
+	}
+
+	const char *lines = getenv("FAKE_JT9_LINES");
+	const char *delay = getenv("FAKE_JT9_DELAY");
+	const std::string lockFile = dir + "/.lock";
+	const std::string quitFile = dir + "/.quit";
+
+	while (true) {
+		// wait for the host to release the lock
+		while (access(lockFile.c_str(), F_OK) == 0) {
+			if (access(quitFile.c_str(), F_OK) == 0)
+				return 0;
+			usleep(10000);
+		}
+		if (access(quitFile.c_str(), F_OK) == 0)
+			return 0;
+
+		// take a copy of the parameters, as jt9 does
+		Jt9Params p = shm.data()->params;
+		if (delay)
+			usleep(atoi(delay) * 1000);
+
+		int decodes = 0;
+		if (lines) {
+			std::ifstream in(lines);
+			std::string line;
+			while (std::getline(in, line)) {
+				printf("%06d %s\n", p.nutc, line.c_str());
+				++decodes;
+			}
+		} else {
+			// report the level of the samples as the SNR field
+			double sum = 0;
+			size_t count = p.kin > 0 ? static_cast<size_t>(p.kin) : 0;
+			for (size_t i = 0; i != count; ++i) {
+				double s = shm.data()->d2[i];
+				sum += s * s;
+			}
+			int level = count ? static_cast<int>(10.0 * log10((sum / count) + 1.0)) : 0;
+			printf("%06d %3d  0.0 %4d ~  CQ FAKE%d AA00\n", p.nutc, level, p.nfqso, p.ndepth);
+			++decodes;
+		}
+		printf("%s %3d %3d %8d\n", KK5JY_JT9_FINISHED, decodes, decodes, 0);
+		fflush(stdout);
+
+		// signal completion by recreating the lock
+		FILE *f = fopen(lockFile.c_str(), "w");
+		if (f)
+			fclose(f);
+	}
+}
+
+// EOF
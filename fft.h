@@ -0,0 +1,217 @@
+/*
+ *
+ *
+ *    fft.h
+ *
+ *    Mixed-radix complex FFT.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    A recursive decimation-in-time FFT for any length; lengths made of
+ *    the factors 2, 3, 4 and 5 are fast (e.g., 3840 = 4^4 * 3 * 5, the
+ *    FT8 analysis frame).  Other prime factors use a generic butterfly.
+ *
+ */
+
+#ifndef __KK5JY_FFT_H
+#define __KK5JY_FFT_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <stdexcept>
+
+namespace KK5JY {
+	namespace DSP {
+		//
+		//  class FFT<T> - a planned forward FFT of fixed length
+		//
+		template <typename T = float>
+		class FFT {
+			public:
+				typedef std::complex<T> complex_t;
+
+			private:
+				size_t m_Size;
+				std::vector<size_t> m_Factors; // radix, then remaining length, per stage
+				std::vector<complex_t> m_Twiddles;
+
+			private:
+				// complex multiply without the C99 Inf/NaN recovery that
+				//    std::complex uses, which is many times slower
+				static complex_t mul(const complex_t &a, const complex_t &b) {
+					return complex_t(
+						a.real() * b.real() - a.imag() * b.imag(),
+						a.real() * b.imag() + a.imag() * b.real());
+				}
+
+				void work(complex_t *out, const complex_t *in, size_t fstride, size_t stage) const;
+				void bfly2(complex_t *out, size_t fstride, size_t m) const;
+				void bfly4(complex_t *out, size_t fstride, size_t m) const;
+				void bflyN(complex_t *out, size_t fstride, size_t m, size_t p) const;
+
+			public:
+				FFT(size_t size);
+
+				// the transform length
+				size_t size() const { return m_Size; }
+
+				// forward transform of 'in' into 'out'; the buffers must
+				//    not overlap, and both hold size() values
+				void forward(const complex_t *in, complex_t *out) const;
+		};
+
+
+		//
+		//  FFT<T>::ctor - factor the length and build the twiddles
+		//
+		template <typename T>
+		inline FFT<T>::FFT(size_t size) : m_Size(size) {
+			if (size == 0)
+				throw std::runtime_error("FFT size must not be zero");
+
+			m_Twiddles.resize(size);
+			for (size_t i = 0; i != size; ++i) {
+				double phase = -2.0 * M_PI * i / size;
+				m_Twiddles[i] = complex_t(std::cos(phase), std::sin(phase));
+			}
+
+			// prefer radix 4, then 2, 3, 5, then whatever is left
+			size_t n = size;
+			size_t p = 4;
+			while (n > 1) {
+				while (n % p) {
+					switch (p) {
+						case 4: p = 2; break;
+						case 2: p = 3; break;
+						default: p += 2; break;
+					}
+					if (p * p > n)
+						p = n;
+				}
+				n /= p;
+				m_Factors.push_back(p);
+				m_Factors.push_back(n);
+			}
+		}
+
+
+		//
+		//  FFT<T>::forward(...)
+		//
+		template <typename T>
+		inline void FFT<T>::forward(const complex_t *in, complex_t *out) const {
+			if (m_Size == 1) {
+				out[0] = in[0];
+				return;
+			}
+			work(out, in, 1, 0);
+		}
+
+
+		//
+		//  FFT<T>::work(...) - one stage of the recursion
+		//
+		template <typename T>
+		inline void FFT<T>::work(complex_t *out, const complex_t *in, size_t fstride, size_t stage) const {
+			const size_t p = m_Factors[stage];     // this stage's radix
+			const size_t m = m_Factors[stage + 1]; // length of each sub-transform
+			complex_t *end = out + (p * m);
+
+			if (m == 1) {
+				for (complex_t *o = out; o != end; ++o, in += fstride)
+					*o = *in;
+			} else {
+				for (complex_t *o = out; o != end; o += m, in += fstride)
+					work(o, in, fstride * p, stage + 2);
+			}
+
+			switch (p) {
+				case 2: bfly2(out, fstride, m); break;
+				case 4: bfly4(out, fstride, m); break;
+				default: bflyN(out, fstride, m, p); break;
+			}
+		}
+
+
+		//
+		//  FFT<T>::bfly2(...)
+		//
+		template <typename T>
+		inline void FFT<T>::bfly2(complex_t *out, size_t fstride, size_t m) const {
+			complex_t *out2 = out + m;
+			const complex_t *tw = &m_Twiddles[0];
+			for (size_t k = 0; k != m; ++k, tw += fstride) {
+				complex_t t = mul(out2[k], *tw);
+				out2[k] = out[k] - t;
+				out[k] += t;
+			}
+		}
+
+
+		//
+		//  FFT<T>::bfly4(...)
+		//
+		template <typename T>
+		inline void FFT<T>::bfly4(complex_t *out, size_t fstride, size_t m) const {
+			const complex_t *tw1 = &m_Twiddles[0];
+			const complex_t *tw2 = tw1;
+			const complex_t *tw3 = tw1;
+			for (size_t k = 0; k != m; ++k) {
+				complex_t s0 = mul(out[k + m], *tw1);
+				complex_t s1 = mul(out[k + 2 * m], *tw2);
+				complex_t s2 = mul(out[k + 3 * m], *tw3);
+				tw1 += fstride;
+				tw2 += fstride * 2;
+				tw3 += fstride * 3;
+
+				complex_t s5 = out[k] - s1;
+				out[k] += s1;
+				complex_t s3 = s0 + s2;
+				complex_t s4 = s0 - s2;
+				out[k + 2 * m] = out[k] - s3;
+				out[k] += s3;
+
+				// multiply s4 by -j (forward transform)
+				out[k + m] = complex_t(s5.real() + s4.imag(), s5.imag() - s4.real());
+				out[k + 3 * m] = complex_t(s5.real() - s4.imag(), s5.imag() + s4.real());
+			}
+		}
+
+
+		//
+		//  FFT<T>::bflyN(...) - any radix; O(p^2), fine for small primes
+		//
+		template <typename T>
+		inline void FFT<T>::bflyN(complex_t *out, size_t fstride, size_t m, size_t p) const {
+			complex_t scratch[16];
+			std::vector<complex_t> big;
+			complex_t *s = scratch;
+			if (p > 16) {
+				big.resize(p);
+				s = &big[0];
+			}
+
+			for (size_t u = 0; u != m; ++u) {
+				for (size_t q = 0, k = u; q != p; ++q, k += m)
+					s[q] = out[k];
+
+				for (size_t q1 = 0, k = u; q1 != p; ++q1, k += m) {
+					size_t twidx = 0;
+					complex_t sum = s[0];
+					for (size_t q = 1; q != p; ++q) {
+						twidx += fstride * k;
+						if (twidx >= m_Size)
+							twidx -= m_Size;
+						sum += mul(s[q], m_Twiddles[twidx]);
+					}
+					out[k] = sum;
+				}
+			}
+		}
+	}
+}
+
+#endif // __KK5JY_FFT_H
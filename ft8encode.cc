@@ -35,6 +35,8 @@ int main(int argc, char**argv) {
 	double rate = atof(argv[2]);
 	double f0 = atof(argv[3]);
 	double bps, shift;
+	double bt = 2.0;    // GFSK bandwidth-time product
+	bool edges = false; // ramp whole symbols in and out
 
 	std::string rmode = my::toLower(mode);
 	if (mode == "ft8") {
@@ -43,6 +45,8 @@ int main(int argc, char**argv) {
 	} else if (mode == "ft4") {
 		bps = 12000.0 / 576.0; //23.391812865497077; 
 		shift = bps;
+		bt = 1.0;
+		edges = true;
 	} else {
 		cerr << "Invalid mode." << std::endl;
 		return 1;
@@ -55,11 +59,16 @@ int main(int argc, char**argv) {
 	//cerr << "Using rate = " << rate << "; bps = " << bps << "; shift = " << shift << "; txt = " << txt << endl;
 
 	// create a new modulator
-	KK5JY::DSP::MFSK::Modulator<float> mfsk(rate, f0, bps, shift);
+	KK5JY::DSP::MFSK::Modulator<float> mfsk(rate, f0, bps, shift, bt, edges);
 	mfsk.setVolume(0.5);
 
 	// encode
-	mfsk.transmit(KK5JY::FT8::encode(mode, txt), f0);
+	std::string symbols = KK5JY::FT8::encode(mode, txt);
+	if (symbols.empty()) {
+		cerr << "Message can't be encoded." << std::endl;
+		return 1;
+	}
+	mfsk.transmit(symbols, f0);
 
 	// write
 	size_t count = 0;
@@ -17,7 +17,11 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define MAX_DECODED_MESSAGES 16
+#define MAX_DECODED_MESSAGES 16 // default; the fourth argument sets it
+#define MAX_COMMAND_LENGTH 512
+#define MAX_PUSH_QUEUE 64     // lines held for a subscriber; the oldest are dropped
+#define MAX_PUSH_PENDING 4096 // bytes of output a client may have unsent before more is held back
+#define MAX_REPLY_BACKLOG 4   // full LOGS replies a client may have held back; more disconnects it
 
 #include <iostream>
 #include <fstream>
@@ -32,9 +36,13 @@ using std::strstr;
 using std::strcmp;
 
 #include <vector>
+#include <deque>
+#include <map>
 using std::vector;
+using std::deque;
 
 #include "snddev.h"
+#include "decodelog.h"
 
 //
 // Call Sign database
@@ -45,11 +53,10 @@ CallSignCountryDriver hamOperatorCountry;
 //
 // TCP Socket
 //
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <unistd.h>
+#include "netserver.h"
 #define PORT 6666
-int server_fd, new_socket;
+using KK5JY::Net::NetClient;
+using KK5JY::Net::NetServer;
 
 
 using namespace std;
@@ -61,19 +68,128 @@ using namespace KK5JY::DSP::MFSK;
 //
 void usage(const std::string &s);
 void handleDecodedMessages(vector<DecodedLine> * newMessagesPtr);
-void printDecodedMessages();
+void printDecodedMessages(NetClient &client);
+void printDecodedMessagesSince(NetClient &client, uint64_t since);
+void formatDecodedMessage(const DecodedLine &message, char *fixedLine);
 void wipeDecodedMessages();
 void *asyncDecodeMessage(void * arg);
-void interpretCommand(string *, ModemSoundDevice* audio);
-void printCallSignCountry(char *);
+void interpretCommand(string *, ModemSoundDevice* audio, NetClient &client);
+void printCallSignCountry(string &, NetClient &client);
+void printTxQueue(ModemSoundDevice* audio, NetClient &client);
 
 
 //
 // Main cache for decoded messages
 //
-vector <DecodedLine> cacheDecodedMessages;
+KK5JY::FT8::DecodedLog *cacheDecodedMessages = 0; // written by the decoder thread only
 int decodedMessageQt = 0;
-bool cqOnlyEnabled = false;
+std::atomic<bool> cqOnlyEnabled(false);
+
+
+//
+//  Network clients; each one has its own command line, and its
+//  replies are buffered, so one slow client doesn't hold up the others
+//
+class ModemNetHandler : public KK5JY::Net::INetHandler {
+	private:
+		// a client that gets new decodes pushed to it
+		struct Subscriber {
+			vector<string> filters; // words to match; empty = all
+			deque<string> queue;    // lines not yet given to the client
+			unsigned long dropped;  // lines dropped since the last notice
+
+			Subscriber() : dropped(0) { /* nop */ }
+		};
+
+		// a decode handed over by the decode thread
+		struct Published {
+			DecodedLine line;
+			bool update; // replaces an early-pass line already pushed
+
+			Published(const DecodedLine &l, bool u) : line(l), update(u) { /* nop */ }
+		};
+
+		// command replies not yet given to a client; kept whole, in order
+		struct Backlog {
+			deque<string> lines;
+			size_t bytes;
+
+			Backlog() : bytes(0) { /* nop */ }
+		};
+
+	private:
+		ModemSoundDevice *m_Audio;
+		NetServer *m_Server;
+		std::map<int, Subscriber> m_Subscribers;
+		std::map<int, Backlog> m_Backlogs;
+		vector<Published> m_Published; // from the decode thread
+		my::mutex m_PublishedLock;
+
+	private:
+		// give queued lines to 'client' while its output is short
+		void pump(NetClient &client, Subscriber &sub);
+
+		// give held-back replies to 'client' while its output is short;
+		//    returns true once none are left
+		bool drain(NetClient &client);
+
+	public:
+		ModemNetHandler(ModemSoundDevice *audio) : m_Audio(audio), m_Server(0) { /* nop */ }
+
+	public:
+		void connected(NetClient &client) {
+			cout << "INFO: Client " << client.id() << " connected from " << client.address() << endl;
+		}
+
+		void disconnected(NetClient &client) {
+			m_Subscribers.erase(client.id());
+			m_Backlogs.erase(client.id());
+			cout << "INFO: Client " << client.id() << " disconnected" << endl;
+		}
+
+		void received(NetClient &client, const char *data, size_t count);
+		void writable(NetClient &client);
+		void woken();
+
+		bool holding(NetClient &client) {
+			return m_Backlogs.find(client.id()) != m_Backlogs.end();
+		}
+
+	public:
+		// set the server, once it exists
+		void attach(NetServer *server) { m_Server = server; }
+
+		// start pushing new decodes to 'client', or change its filters
+		void subscribe(NetClient &client, const vector<string> &filters);
+
+		// stop pushing to 'client'
+		void unsubscribe(NetClient &client) { m_Subscribers.erase(client.id()); }
+
+		// pass a new decode to the subscribers, or with 'update', the
+		//    full decode that replaced an early one; called from the
+		//    decode thread
+		void publish(const DecodedLine &line, bool update = false);
+
+		// send a line of a command reply; a long reply (LOGS) is held
+		//    back and handed out as the client reads it
+		void reply(NetClient &client, const string &line);
+};
+
+std::atomic<ModemNetHandler*> netHandler(0); // decode thread vs. main
+
+
+//
+//  Send a line of a command reply through the handler, which holds
+//  back what the client can't take yet
+//
+inline void sendReply(NetClient &client, const string &line)
+{
+	ModemNetHandler *handler = netHandler;
+	if (handler)
+		handler->reply(client, line);
+	else
+		client.send(line);
+}
 
 
 //
@@ -81,11 +197,6 @@ bool cqOnlyEnabled = false;
 //
 int main(int argc, char**argv) {
 
-	// Network
-	struct sockaddr_in address;
-	int opt = 1;
-	int addrlen = sizeof(address);
-
 	// async decoding
 	pthread_t asyncDecodeThreads[1];
 
@@ -100,8 +211,16 @@ int main(int argc, char**argv) {
 	std::string mode = argv[1];
 	int dev = atoi(argv[2]);
 	short depth = 2; // 2 = Normal
-	if (argc == 3)
-		depth = atoi(argv[2]);
+	if (argc > 3)
+		depth = atoi(argv[3]);
+	int logSize = MAX_DECODED_MESSAGES;
+	if (argc > 4)
+		logSize = atoi(argv[4]);
+	if (logSize < 1 || logSize > 100000) {
+		usage(argv[0]);
+		return 1;
+	}
+	cacheDecodedMessages = new KK5JY::FT8::DecodedLog(logSize);
 	
 	cout << "Selected card is " << dev << endl;
 	// initialize sound card
@@ -119,138 +238,273 @@ int main(int argc, char**argv) {
 	//pthread_join(asyncDecodeThreads[0], (void **)&ret);
 	cout << "App Initialized" << endl;
 
-	// read transmit messages
-	std::string msg = "";
-	char iobuffer[16];
+	// Network start
+	ModemNetHandler handler(&audio);
+	NetServer *server = 0;
+	try {
+		server = new NetServer(PORT, &handler, 16);
+	} catch (const std::exception &e) {
+		perror(e.what());
+		exit(EXIT_FAILURE);
+	}
+	handler.attach(server);
+	netHandler = &handler;
+
 	bool active = false;
+	while (true) {
 
+		if (!active) {
+			active = audio.isActive();
+			if (active)
+				cout << "INFO: Sound callback is active." << endl;
+		}
+
+		// handle client traffic; wake up now and then to check the card
+		server->poll(1000);
 
-	// Creating socket file descriptor
-	if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		perror("socket failed");
-		exit(EXIT_FAILURE);
 	}
 
+	// closing the client and listening sockets
+	netHandler = 0;
+	delete server;
 
-	// Forcefully attach socket to the port 6666
-	if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) 
-	{
-		perror("setsockopt");
-		exit(EXIT_FAILURE);
-	}
+	// stop the sound card
+	audio.stop();
 
-	address.sin_family = AF_INET;
-	address.sin_addr.s_addr = INADDR_ANY;
-	address.sin_port = htons(PORT);
+	
+	// done
+	return 0;
+}
 
 
+//
+// Functions
+// =====================================================================
+//
 
-	// Network start
-   	 if (bind(server_fd, (struct sockaddr*)&address,
-        	     sizeof(address)) < 0) {
-        	perror("bind failed");
-        	exit(EXIT_FAILURE);
-    	}
-    	if (listen(server_fd, 3) < 0) {
-        	perror("listen");
-        	exit(EXIT_FAILURE);
-    	}
+//
+//  Collect command characters from a client; a read may hold several
+//  commands and the start of another, so every complete line is run,
+//  in order, and the rest is kept for the next read
+//
+void ModemNetHandler::received(NetClient &client, const char *data, size_t count)
+{
+	std::string &msg = client.line;
 
-	while (true) {
+	for (size_t i = 0; i != count; ++i) {
+		char ch = data[i];
 
-		if ((new_socket
-			= accept(server_fd, (struct sockaddr*)&address,
-					(socklen_t*)&addrlen))
-			< 0) {
-			perror("accept");
-			exit(EXIT_FAILURE);
-		}
+		// terminate line; the blank line between '\r' and '\n' is skipped
+		if (ch == '\n' || ch == '\r') {
 
-		int ct = 0;
-		
-		while (true) {
+			if (msg.empty())
+				continue;
 
-			if (!active) {
-				active = audio.isActive();
-				if (active)
-					cout << "INFO: Sound callback is active." << endl;
+			// a line this long is no command; drop it
+			if (msg.size() >= MAX_COMMAND_LENGTH) {
+				cout << "ERR: Command too long from client " << client.id() << endl;
+				msg.clear();
+				continue;
 			}
+			
+			cout << "Command Received:\"" << msg << "\" from client " << client.id() << endl;
 
-			//read from network
-			ct = read(new_socket, iobuffer, sizeof(iobuffer));
+			interpretCommand(&msg, m_Audio, client);
+			msg.clear();
+			continue;
 
-			// if EOF, close the program
-			if (ct <= 0) {
-				cout << "None" << endl;
-				break;
-			}
+		}
 
-			// process data from stdin
-			for (int i = 0; i != ct; ++i) {
-				char ch = iobuffer[i];
-
-				// drop non-digits
-				if (isalnum(ch) 
-					|| ch == ' ' 
-					|| ch == '.' 
-					|| ch == '-' 
-					|| ch == '+'
-					|| ch == ';') {
-					msg += ch;
-				}
+		// drop non-digits
+		if (isalnum(ch) 
+			|| ch == ' ' 
+			|| ch == '.' 
+			|| ch == '-' 
+			|| ch == '+'
+			|| ch == ';'
+			|| ch == '@'
+			|| ch == '/'     // portable and /R, /P calls
+			|| ch == '<'     // hashed calls
+			|| ch == '>') {
+			if (msg.size() < MAX_COMMAND_LENGTH)
+				msg += ch;
+		}
+	}
+}
 
-				// terminate line
-				if (ch == '\n' || ch == '\r') {
-					
-					cout << "Command Received:\"" << msg << "\"" << endl;
+//
+//  Start pushing new decodes to a client
+//
+void ModemNetHandler::subscribe(NetClient &client, const vector<string> &filters)
+{
+	Subscriber &sub = m_Subscribers[client.id()];
+	sub.filters = filters;
+	cout << "INFO: Client " << client.id() << " subscribed" << endl;
+}
 
-					interpretCommand(&msg, &audio);
-					msg.clear();
-					break;
 
-				}
+//
+//  Hand a new decode to the network thread
+//
+void ModemNetHandler::publish(const DecodedLine &line, bool update)
+{
+	{
+		my::locker lock(m_PublishedLock);
+		m_Published.push_back(Published(line, update));
+	}
+	if (m_Server)
+		m_Server->wake();
+}
+
+
+//
+//  Queue the published decodes for each subscriber that wants them
+//
+void ModemNetHandler::woken()
+{
+	vector<Published> lines;
+	{
+		my::locker lock(m_PublishedLock);
+		lines.swap(m_Published);
+	}
+
+	char fixedLine[64];
+	for (size_t i = 0; i != lines.size(); ++i) {
+		formatDecodedMessage(lines[i].line, fixedLine);
+		const string message = lines[i].line.getMessage();
+		const string prefix = lines[i].update ? "UPDATE;" : "DECODE;";
+
+		for (auto &item : m_Subscribers) {
+			Subscriber &sub = item.second;
+
+			// any one filter word in the message will do
+			bool match = sub.filters.empty();
+			for (size_t j = 0; j != sub.filters.size() && ! match; ++j) {
+				if (sub.filters[j] == "CQ")
+					match = message.compare(0, 3, "CQ ") == 0;
+				else
+					match = (" " + message + " ").find(" " + sub.filters[j] + " ") != string::npos;
+			}
+			if ( ! match)
+				continue;
+
+			if (sub.queue.size() == MAX_PUSH_QUEUE) {
+				sub.queue.pop_front();
+				++sub.dropped;
 			}
+			sub.queue.push_back(prefix + fixedLine);
 		}
+	}
 
-		// closing the connected socket
-		close(new_socket);
+	// pump() may close a client, but the server only deletes it later
+	for (auto &item : m_Subscribers) {
+		NetClient *client = m_Server->client(item.first);
+		if (client)
+			pump(*client, item.second);
+	}
+}
 
+
+//
+//  A client's socket has room again; replies go first, then decodes
+//
+void ModemNetHandler::writable(NetClient &client)
+{
+	if ( ! drain(client))
+		return;
+	std::map<int, Subscriber>::iterator it = m_Subscribers.find(client.id());
+	if (it != m_Subscribers.end())
+		pump(client, it->second);
+}
+
+
+//
+//  Send a line of a command reply, or hold it back behind the others
+//
+void ModemNetHandler::reply(NetClient &client, const string &line)
+{
+	std::map<int, Backlog>::iterator it = m_Backlogs.find(client.id());
+	if (it == m_Backlogs.end() && client.pending() < MAX_PUSH_PENDING) {
+		client.send(line);
+		return;
 	}
 
-	// stop the sound card
-	audio.stop();
+	Backlog &backlog = m_Backlogs[client.id()];
+	backlog.lines.push_back(line);
+	backlog.bytes += line.size();
 
-    // closing the listening socket
-    shutdown(server_fd, SHUT_RDWR);
+	// a client that keeps asking without reading
+	const size_t limit = MAX_REPLY_BACKLOG * cacheDecodedMessages->capacity() * 64 + KK5JY_NET_MAX_OUTPUT;
+	if (backlog.bytes > limit) {
+		cout << "WARN: Client " << client.id() << " isn't reading its replies; disconnecting" << endl;
+		m_Backlogs.erase(client.id());
+		client.close();
+	}
+}
 
-	
-	// done
-	return 0;
+
+//
+//  Give held-back replies to a client while its output is short
+//
+bool ModemNetHandler::drain(NetClient &client)
+{
+	std::map<int, Backlog>::iterator it = m_Backlogs.find(client.id());
+	if (it == m_Backlogs.end())
+		return true;
+
+	Backlog &backlog = it->second;
+	while ( ! backlog.lines.empty() && client.pending() < MAX_PUSH_PENDING) {
+		backlog.bytes -= backlog.lines.front().size();
+		client.send(backlog.lines.front());
+		backlog.lines.pop_front();
+	}
+	if ( ! backlog.lines.empty())
+		return false;
+	m_Backlogs.erase(it);
+	return true;
 }
 
 
 //
-// Functions
-// =====================================================================
+//  Give queued decodes to a subscriber, but only while its output is
+//  short; the rest wait in its bounded queue
 //
+void ModemNetHandler::pump(NetClient &client, Subscriber &sub)
+{
+	// not in the middle of a reply
+	if (m_Backlogs.count(client.id()))
+		return;
+
+	while ( ! sub.queue.empty() && client.pending() < MAX_PUSH_PENDING) {
+		if (sub.dropped) {
+			char notice[32];
+			sprintf(notice, "DROPPED;%lu\n\r", sub.dropped);
+			client.send(notice);
+			sub.dropped = 0;
+		}
+		client.send(sub.queue.front());
+		sub.queue.pop_front();
+	}
+}
+
 
 //
 //  Try identify the country of a call sign
 //
-void printCallSignCountry(string &callSign)
+void printCallSignCountry(string &callSign, NetClient &client)
 {
 	char countryAssinged[100];
 	countryAssinged[0] = '\0';
 
 	sprintf(countryAssinged, "QRZCOUNTRY;%s\n\r", hamOperatorCountry.getCountry(callSign).c_str());
-	send(new_socket, countryAssinged, strlen(countryAssinged), 0);
+	sendReply(client, countryAssinged);
 	
 }
 
 //
 //  Interpret the command in StdIn or Socket or Serial
 //
-void interpretCommand(string * msg, ModemSoundDevice* audio)
+void interpretCommand(string * msg, ModemSoundDevice* audio, NetClient &client)
 {
 
 	if (my::toUpper((*msg)) == "CQONLYENABLED") {
@@ -277,7 +531,20 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 
 	if (my::toUpper((*msg)) == "LOGS") {
 		(*msg).clear();
-		printDecodedMessages();
+		printDecodedMessages(client);
+		return;
+	}
+
+	if (my::toUpper((*msg)).compare(0, 11, "LOGS SINCE ") == 0) {
+		std::string arg = my::strip((*msg).substr(11));
+		char *end = 0;
+		uint64_t since = strtoull(arg.c_str(), &end, 10);
+		if (arg.empty() || *end != '\0' || ! isdigit(arg[0])) {
+			cout << "ERR: Invalid sequence number" << endl;
+		} else {
+			printDecodedMessagesSince(client, since);
+		}
+		(*msg).clear();
 		return;
 	}
 
@@ -288,6 +555,41 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 		return;
 	}
 
+	if (my::toUpper((*msg)) == "TXQ") {
+		(*msg).clear();
+		printTxQueue(audio, client);
+		return;
+	}
+
+	if (my::toUpper((*msg)) == "UNSUBSCRIBE") {
+		(*msg).clear();
+		if (netHandler)
+			netHandler.load()->unsubscribe(client);
+		return;
+	}
+
+	if (my::toUpper((*msg)).compare(0, 9, "SUBSCRIBE") == 0
+			&& ((*msg).size() == 9 || (*msg)[9] == ' ')) {
+
+		// the words after the command are the filters
+		vector<string> filters;
+		std::string args = my::toUpper((*msg).substr(9));
+		size_t start = 0;
+		while (start < args.size()) {
+			size_t end = args.find(' ', start);
+			if (end == std::string::npos)
+				end = args.size();
+			if (end > start)
+				filters.push_back(args.substr(start, end - start));
+			start = end + 1;
+		}
+
+		if (netHandler)
+			netHandler.load()->subscribe(client, filters);
+		(*msg).clear();
+		return;
+	}
+
 	size_t idx = (*msg).find("QRZCOUNTRY");
 	if (idx != std::string::npos) {
 		
@@ -301,7 +603,7 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 
 		std::string callSign = my::toUpper((*msg).substr(idx+1));
 		cout << callSign << endl;
-		printCallSignCountry(callSign);
+		printCallSignCountry(callSign, client);
 		(*msg).clear();
 		return;
 
@@ -357,11 +659,144 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 		(*msg).clear();
 		return;
 
+	} else if (freq == "DECODERS") {
+
+		int workers = atoi((*msg).c_str());
+
+		if (workers >= 1 && workers <= 16) {
+
+			(*audio).setDecoders(workers);
+
+			cout << "OK: Decoders now " << workers << endl;
+		} else {
+
+			cout << "ERR: Invalid decoder count provided; must be 1 to 16" << endl;
+
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "BANDS") {
+
+		int bands = atoi((*msg).c_str());
+
+		if (bands >= 1 && bands <= 16) {
+
+			(*audio).setBands(bands);
+
+			cout << "OK: Bands now " << bands << endl;
+		} else {
+
+			cout << "ERR: Invalid band count provided; must be 1 to 16" << endl;
+
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "EARLY") {
+
+		if ((*msg) == "ON" || (*msg) == "1") {
+			if ((*audio).setEarly(true))
+				cout << "OK: Early decode now on" << endl;
+			else
+				cout << "ERR: Early decode is only available for FT8" << endl;
+		} else if ((*msg) == "OFF" || (*msg) == "0") {
+			(*audio).setEarly(false);
+			cout << "OK: Early decode now off" << endl;
+		} else {
+			cout << "ERR: Invalid early decode setting; must be ON or OFF" << endl;
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "OVERLOAD") {
+
+		if ((*msg) == "DROP") {
+			(*audio).setOverload(KK5JY::FT8::DecodeScheduler::DropOldest);
+			cout << "OK: Overload now " << (*msg) << endl;
+		} else if ((*msg) == "LOWER") {
+			(*audio).setOverload(KK5JY::FT8::DecodeScheduler::LowerDepth);
+			cout << "OK: Overload now " << (*msg) << endl;
+		} else if ((*msg) == "SKIP") {
+			(*audio).setOverload(KK5JY::FT8::DecodeScheduler::Skip);
+			cout << "OK: Overload now " << (*msg) << endl;
+		} else {
+			cout << "ERR: Invalid overload policy provided; must be DROP, LOWER or SKIP" << endl;
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "TXOFFSET") {
+
+		int offset = atoi((*msg).c_str());
+		if (offset >= -1000 && offset <= 1000 && ((*msg).find_first_of("0123456789") != std::string::npos)) {
+			(*audio).setTxOffset(offset / 1000.0);
+			cout << "OK: TX offset now " << offset << "ms (sound card latency " << static_cast<int>((*audio).getOutputLatency() * 1000) << "ms)" << endl;
+		} else {
+			cout << "ERR: Invalid TX offset provided; must be -1000 to 1000" << endl;
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "REDECODE") {
+
+		long slot = 0;
+		int depth = 3, shift = 0;
+		int fields = sscanf((*msg).c_str(), "%ld %d %d", &slot, &depth, &shift);
+		if (fields < 1 || depth < 1 || depth > 3 || shift < -2000 || shift > 2000) {
+			cout << "ERR: Invalid redecode provided; must be <slot> [depth [shift]]" << endl;
+		} else if ((*audio).redecode(slot, depth, shift / 1000.0)) {
+			cout << "OK: Decoding slot " << slot << " again at depth " << depth << ", shifted " << shift << "ms" << endl;
+		} else {
+			cout << "ERR: Slot " << slot << " is not in the receive history" << endl;
+		}
+
+		(*msg).clear();
+		return;
+
+	} else if (freq == "CANCEL") {
+
+		if ((*msg) == "ALL") {
+			(*audio).cancelTransmit();
+			cout << "OK: Transmit queue cancelled" << endl;
+		} else {
+			unsigned id = strtoul((*msg).c_str(), 0, 10);
+			if (id && (*audio).cancelTransmit(id))
+				cout << "OK: Transmit #" << id << " cancelled" << endl;
+			else
+				cout << "ERR: No such transmit queued: '" << (*msg) << "'" << endl;
+		}
+
+		(*msg).clear();
+		return;
+
 	}
 
-	// handle even/odd
+	// handle an absolute slot number
 	TimeSlots eo = NextSlot;
-	if (freq.size()) {
+	long target = 0;
+	idx = freq.find('@');
+	if (idx != std::string::npos) {
+
+		target = atol(freq.substr(idx + 1).c_str());
+		freq = freq.substr(0, idx);
+		eo = AbsoluteSlot;
+
+		if (target < (*audio).currentSlot()) {
+			cout << "ERR: Slot " << target << " has passed; now in slot " << (*audio).currentSlot() << endl;
+			(*msg).clear();
+			return;
+		}
+
+	}
+
+	// handle even/odd
+	if (freq.size() && eo == NextSlot) {
 
 		char eoc = freq[freq.size() - 1];
 
@@ -389,18 +824,43 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 
 	// read the frequency
 	double f = atof(freq.c_str());
-	if (f > 0) {
+	if (f <= 0) {
+
+		cout << "ERR: Invalid frequency specified" << endl;
+		return;
 
-		cout << "OK: Send @ " << f << "Hz: '" << msg << "'" << endl;
-		(*audio).transmit((*msg), f, eo);
-		(*msg) = "";
+	}
 
-	} else {
+	// more messages for the same slot follow as ';<frequency> <message>'
+	vector<TxStream> streams;
+	idx = (*msg).find(';');
+	streams.push_back(TxStream(my::strip((*msg).substr(0, idx)), f));
+	while (idx != std::string::npos) {
+
+		size_t next = (*msg).find(';', idx + 1);
+		string part = my::strip((*msg).substr(idx + 1, next == std::string::npos ? next : next - idx - 1));
+		idx = next;
+
+		size_t sp = part.find(' ');
+		double fi = atof(part.substr(0, sp).c_str());
+		if (sp == std::string::npos || fi <= 0) {
+			cout << "ERR: Invalid frequency specified: '" << part << "'" << endl;
+			(*msg).clear();
+			return;
+		}
+		streams.push_back(TxStream(my::strip(part.substr(sp + 1)), fi));
 
-		cout << "ERR: Invalid frequency specified" << endl;
-		
 	}
 
+	unsigned id = (*audio).transmit(streams, eo, target);
+	if (id) {
+		for (size_t i = 0; i != streams.size(); ++i)
+			cout << "OK: Send @ " << streams[i].f0 << "Hz: '" << streams[i].message << "' as #" << id << endl;
+	} else {
+		cout << "ERR: Message can't be encoded: '" << (*msg) << "'" << endl;
+	}
+	(*msg) = "";
+
 }
 
 
@@ -409,7 +869,7 @@ void interpretCommand(string * msg, ModemSoundDevice* audio)
 //
 void usage(const std::string &s) {
 	cerr << endl;
-	cerr << "Usage: " << s << " <mode> <device> [depth]" << endl;
+	cerr << "Usage: " << s << " <mode> <device> [depth [messages]]" << endl;
 	cerr << endl;
 	SoundCard::showDevices();
 }
@@ -431,14 +891,6 @@ void handleDecodedMessages(vector<DecodedLine> * newMessagesPtr)
 	
 		for (long unsigned int i = 0; i < (*newMessagesPtr).size(); i++) {
 		
-			if (cacheDecodedMessages.size() > MAX_DECODED_MESSAGES) {
-
-				cacheDecodedMessages.erase(cacheDecodedMessages.end());
-			
-			}
-
-						
-
 			if (cqOnlyEnabled == true) 
 			{
 				tmpMsg[0] = '\0';
@@ -451,7 +903,30 @@ void handleDecodedMessages(vector<DecodedLine> * newMessagesPtr)
 			}
 			
 
-			cacheDecodedMessages.insert(cacheDecodedMessages.begin(), (*newMessagesPtr)[i]);
+			// an early pass decode of the same message in the same slot is
+			//    replaced by the full decode's, which takes precedence; it
+			//    gets a new number, so LOGS SINCE hands it out again
+			bool early = false;
+			uint64_t seq = cacheDecodedMessages->find((*newMessagesPtr)[i], early);
+			if (seq != 0) {
+				if (early && ! (*newMessagesPtr)[i].isEarly()) {
+					(*newMessagesPtr)[i].setSequence(cacheDecodedMessages->replace(seq, (*newMessagesPtr)[i]));
+
+					// subscribers were pushed the early line; send its update
+					ModemNetHandler *handler = netHandler;
+					if (handler)
+						handler->publish((*newMessagesPtr)[i], true);
+				}
+				continue;
+			}
+
+			// the oldest message drops out once the log is full
+			(*newMessagesPtr)[i].setSequence(cacheDecodedMessages->add((*newMessagesPtr)[i]));
+
+			// and push it to the subscribed clients
+			ModemNetHandler *handler = netHandler;
+			if (handler)
+				handler->publish((*newMessagesPtr)[i]);
 
 			cerr << (*newMessagesPtr)[i].getContent().c_str() << endl;
 
@@ -470,140 +945,154 @@ void handleDecodedMessages(vector<DecodedLine> * newMessagesPtr)
 
 void wipeDecodedMessages() 
 {
-	cacheDecodedMessages.clear();
+	cacheDecodedMessages->wipe();
 	cout << "Decoded messages cache cleanned" << endl;
 }
 
 
 // 
-// Print decoded messages on demand
+// Format a decoded message as a 'time;dB;dt;freq;from;to;grid' line
 //
 
-void printDecodedMessages()
+void formatDecodedMessage(const DecodedLine &message, char *fixedLine)
 {
-		
-	char fixedLine[64];
+
 	char csvLine[128];
 	char tmpMsg[128];
 
-	fixedLine[0] = '\0';
-	csvLine[0] = '\0';
-	tmpMsg[0] = '\0';
-
-	int qtDM = 0;
 	char *decodedMessagePtr = 0;
 	char *msgContent = 0;
-	char *cqFoundPtr = 0;
 
-	for (const auto message: cacheDecodedMessages) {
+	sprintf(tmpMsg,"%s",message.getContent().c_str());
 
-		sprintf(tmpMsg,"%s",message.getContent().c_str());
+	csvLine[0] = '\0';
+	msgContent = const_cast<char*>(tmpMsg);
 
-		csvLine[0] = '\0';
-		msgContent = const_cast<char*>(tmpMsg);
+	decodedMessagePtr = strtok(msgContent, " ");
+	if(decodedMessagePtr != 0)
+	{
+		//dB
+		strcat(csvLine, decodedMessagePtr);
+		strcat(csvLine, ";");
+		decodedMessagePtr = strtok(NULL, " ");
 
-		decodedMessagePtr = strtok(msgContent, " ");
-		if(decodedMessagePtr != 0)
-		{
-			//dB
-			strcat(csvLine, decodedMessagePtr);
-			strcat(csvLine, ";");
-			decodedMessagePtr = strtok(NULL, " ");
+	} else {
 
-		} else {
+		strcat(csvLine, "-;");
 
-			strcat(csvLine, "-;");
+	}
 
-		}
+	if(decodedMessagePtr != 0)
+	{
+		//dt
+		strcat(csvLine, decodedMessagePtr);
+		strcat(csvLine, ";");
+		decodedMessagePtr = strtok(NULL, " ");
+	} else {
 
-		if(decodedMessagePtr != 0)
-		{
-			//dt
-			strcat(csvLine, decodedMessagePtr);
-			strcat(csvLine, ";");
-			decodedMessagePtr = strtok(NULL, " ");
-		} else {
+		strcat(csvLine, "-;");
 
-			strcat(csvLine, "-;");
+	}
 
-		}
+	if(decodedMessagePtr != 0)
+	{
+		//Frequency
+		strcat(csvLine, decodedMessagePtr);
+		strcat(csvLine, ";");
+		decodedMessagePtr = strtok(NULL, " ");
+	
+	} else {
 
-		if(decodedMessagePtr != 0)
-		{
-			//Frequency
-			strcat(csvLine, decodedMessagePtr);
-			strcat(csvLine, ";");
-			decodedMessagePtr = strtok(NULL, " ");
-		
-		} else {
+		strcat(csvLine, "-;");
 
-			strcat(csvLine, "-;");
+	}
 
-		}
+	//Ignored
+	if(decodedMessagePtr != 0)
+	{
+		decodedMessagePtr = strtok(NULL, " ");
+	}
+	if(decodedMessagePtr != 0) {
+
+		//Souce Call Sign or CQ
+		strcat(csvLine, decodedMessagePtr);
+		decodedMessagePtr = strtok(NULL, " ");
+	} else {
+
+		strcat(csvLine, "-;");
+
+	}
 
-		//Ignored
-		if(decodedMessagePtr != 0)
+	if(decodedMessagePtr != 0) {
+
+		if (strlen(decodedMessagePtr) <= 1)
 		{
+
+			strcat(csvLine, " ");
+			strcat(csvLine, decodedMessagePtr);
+			strcat(csvLine, ";");
 			decodedMessagePtr = strtok(NULL, " ");
+
+		} else {
+			strcat(csvLine, ";");
 		}
-		if(decodedMessagePtr != 0) {
 
-			//Souce Call Sign or CQ
+		if (decodedMessagePtr != 0) {
+			//Destination Call Sign
 			strcat(csvLine, decodedMessagePtr);
+			strcat(csvLine, ";");
 			decodedMessagePtr = strtok(NULL, " ");
+		
 		} else {
 
 			strcat(csvLine, "-;");
 
 		}
 
-		if(decodedMessagePtr != 0) {
+	} else {
 
-			if (strlen(decodedMessagePtr) <= 1)
-			{
+		strcat(csvLine, "-;");
 
-				strcat(csvLine, " ");
-				strcat(csvLine, decodedMessagePtr);
-				strcat(csvLine, ";");
-				decodedMessagePtr = strtok(NULL, " ");
+	}
 
-			} else {
-				strcat(csvLine, ";");
-			}
+	if(decodedMessagePtr != 0) {
 
-			if (decodedMessagePtr != 0) {
-				//Destination Call Sign
-				strcat(csvLine, decodedMessagePtr);
-				strcat(csvLine, ";");
-				decodedMessagePtr = strtok(NULL, " ");
-			
-			} else {
+		//Grid Square Locator or Rec Signal
+		strcat(csvLine, decodedMessagePtr);
+		strcat(csvLine, ";");
 
-				strcat(csvLine, "-;");
+	} else {
 
-			}
+		strcat(csvLine, "-;");
 
-		} else {
+	}
 
-			strcat(csvLine, "-;");
+	sprintf(fixedLine,"%10ld;%.36s\n\r",message.getTime(), csvLine);
 
-		}
+}
 
-		if(decodedMessagePtr != 0) {
 
-			//Grid Square Locator or Rec Signal
-			strcat(csvLine, decodedMessagePtr);
-			strcat(csvLine, ";");
+// 
+// Print decoded messages on demand
+//
 
-		} else {
+void printDecodedMessages(NetClient &client)
+{
+		
+	char fixedLine[64];
+	fixedLine[0] = '\0';
 
-			strcat(csvLine, "-;");
+	int qtDM = 0;
 
-		}
+	// a copy, so the decoder thread is never held up
+	vector<DecodedLine> messages;
+	cacheDecodedMessages->snapshot(messages);
+
+	for (const auto &message: messages) {
 
-		sprintf(fixedLine,"%10ld;%.36s\n\r",message.getTime(), csvLine);
+		formatDecodedMessage(message, fixedLine);
 
-		send(new_socket, fixedLine, strlen(fixedLine), 0);
+		sendReply(client, fixedLine);
 
 		cout << "Command response:" << fixedLine << endl;
 
@@ -613,13 +1102,84 @@ void printDecodedMessages()
     if (qtDM == 0)
 	{
 		sprintf(fixedLine,"EMPTY\n\r");
-		send(new_socket, fixedLine, strlen(fixedLine), 0);
+		sendReply(client, fixedLine);
 		
 	}
 	
 }
 
 
+// 
+// Print the decoded messages newer than 'since', then the newest
+// sequence number, so a client can ask for only what it hasn't seen
+//
+
+void printDecodedMessagesSince(NetClient &client, uint64_t since)
+{
+
+	char fixedLine[64];
+	fixedLine[0] = '\0';
+
+	// numbers are never reused, so one from the future means the
+	//    modem was restarted; send everything
+	if (since > cacheDecodedMessages->sequence())
+		since = 0;
+
+	vector<DecodedLine> messages;
+	uint64_t newest = cacheDecodedMessages->snapshot(messages, since);
+
+	for (const auto &message: messages) {
+
+		formatDecodedMessage(message, fixedLine);
+		sendReply(client, fixedLine);
+
+	}
+
+	sprintf(fixedLine, "SEQ;%llu\n\r", (unsigned long long)newest);
+	sendReply(client, fixedLine);
+
+}
+
+
+// 
+// List the transmit queue on demand
+//
+
+void printTxQueue(ModemSoundDevice* audio, NetClient &client)
+{
+
+	char fixedLine[128];
+	static const char *states[] = { "QUEUED", "READY", "SENDING" };
+
+	vector<TxStatus> queue = (*audio).txQueue();
+
+	for (size_t i = 0; i != queue.size(); ++i) {
+
+		char slot[24];
+		switch (queue[i].slot) {
+			case EvenSlot: sprintf(slot, "EVEN"); break;
+			case OddSlot: sprintf(slot, "ODD"); break;
+			case AbsoluteSlot: sprintf(slot, "%ld", queue[i].target); break;
+			default: sprintf(slot, "NEXT"); break;
+		}
+
+		// one line per message sent in the slot
+		for (size_t j = 0; j != queue[i].streams.size(); ++j) {
+			snprintf(fixedLine, sizeof(fixedLine), "%u;%s;%s;%.0f;%.40s\n\r",
+				queue[i].id, states[queue[i].state], slot,
+				queue[i].streams[j].f0, queue[i].streams[j].message.c_str());
+			sendReply(client, fixedLine);
+		}
+
+	}
+
+	// the current slot number, for choosing absolute slots
+	sprintf(fixedLine, "SLOT;%ld\n\r", (*audio).currentSlot());
+	sendReply(client, fixedLine);
+
+}
+
+
 // 
 // Async decode reading
 //
@@ -628,7 +1188,8 @@ void *asyncDecodeMessage(void * arg)
 	
 	while (true > 0) {
 
-		// process messages in the decoder
+		// process messages in the decoder; run() sleeps until there
+		//    are new decodes, so this loop doesn't spin
 		vector<DecodedLine> *decLinesPtr = ((ModemSoundDevice *)arg)->run();
 		handleDecodedMessages(decLinesPtr);
 		delete decLinesPtr;
@@ -0,0 +1,646 @@
+/*
+ *
+ *
+ *    ft8msg.h
+ *
+ *    FT8/FT4 77-bit message formats.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    Follows 'packjt77.f90' from WSJT-X.  Unpacking handles the formats
+ *    seen in normal operation: standard messages with a grid or report
+ *    (types 1 and 2), nonstandard calls (type 4), free text (0.0),
+ *    DXpedition mode (0.1) and telemetry (0.5).  The contest formats
+ *    (0.3, 0.4, 3 and 5) are not decoded.  Packing handles types 1, 2
+ *    and 4, and free text.
+ *
+ */
+
+#ifndef __KK5JY_FT8_MSG_H
+#define __KK5JY_FT8_MSG_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+#include "stype.h"
+#include "locker.h"
+
+namespace KK5JY {
+	namespace FT8 {
+		// c28 field layout
+		const uint32_t FT8_NTOKENS = 2063592;
+		const uint32_t FT8_MAX22 = 4194304;
+		const uint32_t FT8_MAXGRID4 = 32400;
+
+		// character sets
+		static const char *FT8_A1 = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"; // call position 1
+		static const char *FT8_A2 = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";  // call position 2
+		static const char *FT8_A3 = "0123456789";                            // call position 3
+		static const char *FT8_A4 = " ABCDEFGHIJKLMNOPQRSTUVWXYZ";           // call positions 4-6
+		static const char *FT8_C38 = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ/"; // c58 and hashing
+		static const char *FT8_C42 = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ+-./?"; // free text
+
+
+		//
+		//  class CallHashes - calls heard recently, by their 22-bit hash,
+		//     so that '<...>' fields can be shown as the call; shared by
+		//     all decoder threads
+		//
+		class CallHashes {
+			private:
+				my::mutex m_Lock;
+				std::map<uint32_t, std::string> m_Calls;
+
+			public:
+				// the m-bit hash of a call (m = 10, 12 or 22)
+				static uint32_t hash(const std::string &call, int m) {
+					uint64_t n = 0;
+					for (size_t i = 0; i != 11; ++i) {
+						char ch = i < call.size() ? call[i] : ' ';
+						const char *p = ::strchr(FT8_C38, ch);
+						n = 38 * n + ((p && ch) ? (p - FT8_C38) : 0);
+					}
+					return static_cast<uint32_t>((47055833459ULL * n) >> (64 - m));
+				}
+
+				// remember a call
+				void add(const std::string &call) {
+					if (call.size() < 3 || call[0] == '<')
+						return;
+					my::locker lock(m_Lock);
+					m_Calls[hash(call, 22)] = call;
+				}
+
+				// the call for an m-bit hash, as '<CALL>', or '<...>'
+				std::string find(uint32_t h, int m) {
+					my::locker lock(m_Lock);
+					std::map<uint32_t, std::string>::const_iterator i;
+					for (i = m_Calls.begin(); i != m_Calls.end(); ++i) {
+						if ((i->first >> (22 - m)) == h)
+							return "<" + i->second + ">";
+					}
+					return "<...>";
+				}
+
+				// the process-wide table
+				static CallHashes &instance() {
+					static CallHashes table;
+					return table;
+				}
+		};
+
+
+		//
+		//  class Bits77 - reads fields from a packed 77-bit payload
+		//
+		class Bits77 {
+			private:
+				const uint8_t *m_Data;
+				int m_Pos;
+
+			public:
+				Bits77(const uint8_t *data, int pos = 0) : m_Data(data), m_Pos(pos) { /* nop */ }
+
+				// read the next 'n' bits (n <= 64), most significant first
+				uint64_t read(int n) {
+					uint64_t result = 0;
+					for (int i = 0; i != n; ++i, ++m_Pos)
+						result = (result << 1) | ((m_Data[m_Pos / 8] >> (7 - (m_Pos % 8))) & 1);
+					return result;
+				}
+		};
+
+
+		//
+		//  unpack_c28(...) - a call or token; standard calls are added to
+		//     the hash table
+		//
+		inline std::string unpack_c28(uint32_t n28) {
+			if (n28 < FT8_NTOKENS) {
+				if (n28 == 0) return "DE";
+				if (n28 == 1) return "QRZ";
+				if (n28 == 2) return "CQ";
+				if (n28 <= 1002) {
+					char buf[8];
+					snprintf(buf, sizeof(buf), "CQ %03u", n28 - 3);
+					return buf;
+				}
+				if (n28 <= 532443) {
+					// 'CQ ABCD'
+					uint32_t n = n28 - 1003;
+					char buf[5];
+					for (int i = 3; i >= 0; --i) {
+						buf[i] = FT8_A4[n % 27];
+						n /= 27;
+					}
+					buf[4] = 0;
+					return "CQ " + my::strip(buf);
+				}
+				return "";
+			}
+
+			n28 -= FT8_NTOKENS;
+			if (n28 < FT8_MAX22)
+				return CallHashes::instance().find(n28, 22);
+
+			// a standard call
+			uint32_t n = n28 - FT8_MAX22;
+			char buf[7];
+			buf[5] = FT8_A4[n % 27]; n /= 27;
+			buf[4] = FT8_A4[n % 27]; n /= 27;
+			buf[3] = FT8_A4[n % 27]; n /= 27;
+			buf[2] = FT8_A3[n % 10]; n /= 10;
+			buf[1] = FT8_A2[n % 36]; n /= 36;
+			if (n > 36)
+				return "";
+			buf[0] = FT8_A1[n];
+			buf[6] = 0;
+			std::string call = my::strip(buf);
+
+			// the two prefixes that don't fit the standard pattern
+			if (call.compare(0, 3, "3D0") == 0 && call.size() > 3 && call[3] != ' ')
+				call = "3DA0" + call.substr(3);
+			else if (call.size() > 1 && call[0] == 'Q' && isalpha(call[1]))
+				call = "3X" + call.substr(1);
+
+			CallHashes::instance().add(call);
+			return call;
+		}
+
+
+		//
+		//  unpack_report(...) - a signal report in dB, as '+05' or '-12'
+		//
+		inline std::string unpack_report(int db) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "%+03d", db);
+			return buf;
+		}
+
+
+		//
+		//  unpack77(...) - the text of a 77-bit payload (10 bytes, most
+		//     significant bit first); returns an empty string for formats
+		//     that aren't supported
+		//
+		inline std::string unpack77(const uint8_t *payload) {
+			Bits77 tail(payload, 71);
+			const int n3 = static_cast<int>(tail.read(3));
+			const int i3 = static_cast<int>(tail.read(3));
+			Bits77 bits(payload);
+
+			if (i3 == 1 || i3 == 2) {
+				// standard message
+				uint32_t n28a = bits.read(28);
+				int ipa = bits.read(1);
+				uint32_t n28b = bits.read(28);
+				int ipb = bits.read(1);
+				int ir = bits.read(1);
+				uint32_t igrid4 = bits.read(15);
+
+				std::string call1 = unpack_c28(n28a);
+				std::string call2 = unpack_c28(n28b);
+				if (call1.empty() || call2.empty())
+					return "";
+				const char *suffix = (i3 == 1) ? "/R" : "/P";
+				if (ipa && call1[0] != '<')
+					call1 += suffix;
+				if (ipb && call2[0] != '<')
+					call2 += suffix;
+
+				std::string msg = call1 + " " + call2;
+				if (igrid4 <= FT8_MAXGRID4) {
+					char grid[5];
+					uint32_t n = igrid4;
+					grid[3] = '0' + (n % 10); n /= 10;
+					grid[2] = '0' + (n % 10); n /= 10;
+					grid[1] = 'A' + (n % 18); n /= 18;
+					grid[0] = 'A' + n;
+					grid[4] = 0;
+					if (n >= 18)
+						return "";
+					msg += ir ? " R " : " ";
+					msg += grid;
+				} else {
+					int irpt = igrid4 - FT8_MAXGRID4;
+					switch (irpt) {
+						case 1: break;
+						case 2: msg += " RRR"; break;
+						case 3: msg += " RR73"; break;
+						case 4: msg += " 73"; break;
+						default:
+							// reports below -30dB wrap around to the top
+							msg += ir ? " R" : " ";
+							msg += unpack_report(irpt - 35 > 50 ? irpt - 136 : irpt - 35);
+							break;
+					}
+				}
+				return msg;
+			}
+
+			if (i3 == 4) {
+				// one nonstandard call, one hashed call
+				uint32_t n12 = bits.read(12);
+				uint64_t n58 = bits.read(58);
+				int iflip = bits.read(1);
+				int nrpt = bits.read(2);
+				int icq = bits.read(1);
+
+				char buf[12];
+				for (int i = 10; i >= 0; --i) {
+					buf[i] = FT8_C38[n58 % 38];
+					n58 /= 38;
+				}
+				buf[11] = 0;
+				std::string c11 = my::strip(buf);
+				CallHashes::instance().add(c11);
+
+				if (icq)
+					return "CQ " + c11;
+
+				std::string hashed = CallHashes::instance().find(n12, 12);
+				std::string msg = iflip ? (c11 + " " + hashed) : (hashed + " " + c11);
+				switch (nrpt) {
+					case 1: msg += " RRR"; break;
+					case 2: msg += " RR73"; break;
+					case 3: msg += " 73"; break;
+				}
+				return msg;
+			}
+
+			if (i3 == 0 && n3 == 0) {
+				// free text: 71 bits, 13 characters in base 42
+				unsigned __int128 n = 0;
+				for (int i = 0; i != 71; ++i)
+					n = (n << 1) | bits.read(1);
+				char buf[14];
+				for (int i = 12; i >= 0; --i) {
+					buf[i] = FT8_C42[static_cast<int>(n % 42)];
+					n /= 42;
+				}
+				buf[13] = 0;
+				return my::strip(buf);
+			}
+
+			if (i3 == 0 && n3 == 1) {
+				// DXpedition mode: 'K1ABC RR73; W9XYZ <KH1/KH7Z> -08'
+				std::string call1 = unpack_c28(bits.read(28));
+				std::string call2 = unpack_c28(bits.read(28));
+				uint32_t n10 = bits.read(10);
+				int n5 = bits.read(5);
+				if (call1.empty() || call2.empty())
+					return "";
+				return call1 + " RR73; " + call2 + " " +
+					CallHashes::instance().find(n10, 10) + " " + unpack_report(2 * n5 - 30);
+			}
+
+			if (i3 == 0 && n3 == 5) {
+				// telemetry: 71 bits as hex, without leading zeros
+				uint32_t a = bits.read(23);
+				uint32_t b = bits.read(24);
+				uint32_t c = bits.read(24);
+				char buf[24];
+				snprintf(buf, sizeof(buf), "%06X%06X%06X", a, b, c);
+				const char *p = buf;
+				while (*p == '0' && p[1])
+					++p;
+				return p;
+			}
+
+			// contest formats are not supported
+			return "";
+		}
+
+		//
+		//  class Packer77 - writes fields into a 77-bit payload
+		//
+		class Packer77 {
+			private:
+				uint8_t *m_Data;
+				int m_Pos;
+
+			public:
+				Packer77(uint8_t *data) : m_Data(data), m_Pos(0) { ::memset(data, 0, 10); }
+
+				// append the low 'n' bits of 'value' (n <= 64), most
+				//    significant first
+				void write(uint64_t value, int n) {
+					for (int i = n - 1; i >= 0; --i, ++m_Pos) {
+						if ((value >> i) & 1)
+							m_Data[m_Pos / 8] |= 0x80 >> (m_Pos % 8);
+					}
+				}
+		};
+
+
+		//
+		//  pack_std_call(...) - a standard call (a one or two character
+		//     prefix with at least one letter, a digit, then one to three
+		//     letters) as the low part of a c28 field
+		//
+		inline bool pack_std_call(std::string call, uint32_t &n) {
+			// the two prefixes that don't fit the pattern
+			if (call.compare(0, 4, "3DA0") == 0 && call.size() > 4)
+				call = "3D0" + call.substr(4);
+			else if (call.size() > 2 && call[0] == '3' && call[1] == 'X' && isalpha(call[2]))
+				call = "Q" + call.substr(2);
+			if (call.size() < 3 || call.size() > 6)
+				return false;
+
+			// the call area is the last digit
+			std::string::size_type area = call.find_last_of("0123456789");
+			if (area != 1 && area != 2)
+				return false;
+			bool letter = false;
+			for (std::string::size_type i = 0; i != area; ++i) {
+				if ( ! isupper(call[i]) && ! isdigit(call[i]))
+					return false;
+				letter = letter || isupper(call[i]);
+			}
+			if ( ! letter || call.size() - area - 1 < 1 || call.size() - area - 1 > 3)
+				return false;
+			for (std::string::size_type i = area + 1; i != call.size(); ++i) {
+				if ( ! isupper(call[i]))
+					return false;
+			}
+
+			// align the digit to the third position, and pad to six
+			if (area == 1)
+				call = " " + call;
+			call.resize(6, ' ');
+
+			n = ::strchr(FT8_A1, call[0]) - FT8_A1;
+			n = (n * 36) + (::strchr(FT8_A2, call[1]) - FT8_A2);
+			n = (n * 10) + (::strchr(FT8_A3, call[2]) - FT8_A3);
+			for (int i = 3; i != 6; ++i)
+				n = (n * 27) + (::strchr(FT8_A4, call[i]) - FT8_A4);
+			return true;
+		}
+
+
+		//
+		//  pack_c28(...) - a token, a CQ with modifier ('CQ_DX', 'CQ_290'),
+		//     a hashed call ('<PJ4/K1ABC>'), or a standard call
+		//
+		inline bool pack_c28(const std::string &word, uint32_t &n28) {
+			if (word == "DE") { n28 = 0; return true; }
+			if (word == "QRZ") { n28 = 1; return true; }
+			if (word == "CQ") { n28 = 2; return true; }
+			if (word.compare(0, 3, "CQ_") == 0) {
+				const std::string mod = word.substr(3);
+				if (mod.size() == 3 && my::isDigit(mod)) {
+					n28 = 3 + atoi(mod.c_str());
+					return true;
+				}
+				if (mod.empty() || mod.size() > 4 || ! my::isUpper(mod))
+					return false;
+				// right-aligned, spaces first
+				uint32_t m = 0;
+				for (size_t i = 0; i != 4; ++i) {
+					const size_t pad = 4 - mod.size();
+					m = (m * 27) + ((i < pad) ? 0 : (mod[i - pad] - 'A' + 1));
+				}
+				n28 = 1003 + m;
+				return true;
+			}
+			if (word.size() > 2 && word[0] == '<' && word[word.size() - 1] == '>') {
+				const std::string call = word.substr(1, word.size() - 2);
+				CallHashes::instance().add(call);
+				n28 = FT8_NTOKENS + CallHashes::hash(call, 22);
+				return true;
+			}
+			uint32_t n;
+			if ( ! pack_std_call(word, n))
+				return false;
+			n28 = FT8_NTOKENS + FT8_MAX22 + n;
+			return true;
+		}
+
+
+		//
+		//  is_grid4(...) - true iff 'word' is a four-character locator
+		//
+		inline bool is_grid4(const std::string &word) {
+			return word.size() == 4 && word != "RR73" &&
+				word[0] >= 'A' && word[0] <= 'R' && word[1] >= 'A' && word[1] <= 'R' &&
+				isdigit(word[2]) && isdigit(word[3]);
+		}
+
+
+		//
+		//  pack_report(...) - '+05' or '-12' as an igrid4 value
+		//
+		inline bool pack_report(const std::string &word, uint32_t &igrid4) {
+			if (word.size() < 2 || word.size() > 3 || (word[0] != '+' && word[0] != '-'))
+				return false;
+			if ( ! my::isDigit(word.substr(1)))
+				return false;
+			int rpt = atoi(word.c_str());
+			if (rpt < -50 || rpt > 49)
+				return false;
+			if (rpt < -30)
+				rpt += 101;
+			igrid4 = FT8_MAXGRID4 + 35 + rpt;
+			return true;
+		}
+
+
+		//
+		//  pack77_std(...) - types 1 and 2: two calls, then a grid, report,
+		//     acknowledgement, or nothing
+		//
+		inline bool pack77_std(const std::vector<std::string> &words, uint8_t *payload) {
+			if (words.size() < 2 || words.size() > 4)
+				return false;
+
+			// the grid or report
+			int ir = 0;
+			uint32_t igrid4 = FT8_MAXGRID4 + 1;
+			if (words.size() == 4) {
+				if (words[2] != "R" || ! is_grid4(words[3]))
+					return false;
+				ir = 1;
+			}
+			if (words.size() >= 3) {
+				const std::string &w = words.back();
+				if (is_grid4(w)) {
+					igrid4 = (((w[0] - 'A') * 18 + (w[1] - 'A')) * 100) + ((w[2] - '0') * 10) + (w[3] - '0');
+				} else if (w == "RRR") {
+					igrid4 = FT8_MAXGRID4 + 2;
+				} else if (w == "RR73") {
+					igrid4 = FT8_MAXGRID4 + 3;
+				} else if (w == "73") {
+					igrid4 = FT8_MAXGRID4 + 4;
+				} else if (w[0] == 'R' && pack_report(w.substr(1), igrid4)) {
+					ir = 1;
+				} else if ( ! pack_report(w, igrid4)) {
+					return false;
+				}
+			}
+
+			// the calls, with their /R or /P suffixes
+			uint32_t n28[2];
+			int suffix[2] = { 0, 0 }; // 1 for /R, 2 for /P
+			for (int i = 0; i != 2; ++i) {
+				std::string call = words[i];
+				if (call.size() > 2 && call[call.size() - 2] == '/') {
+					const char s = call[call.size() - 1];
+					if (s != 'R' && s != 'P')
+						return false;
+					suffix[i] = (s == 'R') ? 1 : 2;
+					call.resize(call.size() - 2);
+				}
+				if ( ! pack_c28(call, n28[i]))
+					return false;
+			}
+			if (suffix[0] && suffix[1] && suffix[0] != suffix[1])
+				return false;
+			const int i3 = (suffix[0] == 2 || suffix[1] == 2) ? 2 : 1;
+
+			Packer77 bits(payload);
+			bits.write(n28[0], 28);
+			bits.write(suffix[0] ? 1 : 0, 1);
+			bits.write(n28[1], 28);
+			bits.write(suffix[1] ? 1 : 0, 1);
+			bits.write(ir, 1);
+			bits.write(igrid4, 15);
+			bits.write(i3, 3);
+			return true;
+		}
+
+
+		//
+		//  pack77_nonstd(...) - type 4: one call that isn't standard, with
+		//     a hashed call or CQ, then an acknowledgement or nothing
+		//
+		inline bool pack77_nonstd(const std::vector<std::string> &words, uint8_t *payload) {
+			if (words.size() < 2 || words.size() > 3)
+				return false;
+
+			int nrpt = 0;
+			if (words.size() == 3) {
+				if (words[2] == "RRR") nrpt = 1;
+				else if (words[2] == "RR73") nrpt = 2;
+				else if (words[2] == "73") nrpt = 3;
+				else return false;
+			}
+
+			// which call is sent in full, and which as a hash
+			int icq = 0, iflip = 0;
+			std::string full, hashed;
+			uint32_t n;
+			if (words[0] == "CQ") {
+				if (nrpt)
+					return false;
+				icq = 1;
+				full = words[1];
+			} else if (words[0][0] == '<' || pack_std_call(words[0], n)) {
+				hashed = words[0];
+				full = words[1];
+			} else if (words[1][0] == '<' || pack_std_call(words[1], n)) {
+				hashed = words[1];
+				full = words[0];
+				iflip = 1;
+			} else {
+				return false;
+			}
+			if (hashed.size() > 2 && hashed[0] == '<' && hashed[hashed.size() - 1] == '>')
+				hashed = hashed.substr(1, hashed.size() - 2);
+			if (full.empty() || full.size() > 11 || full[0] == '<')
+				return false;
+
+			// the full call, right-aligned
+			uint64_t n58 = 0;
+			for (size_t i = 0; i != full.size(); ++i) {
+				const char *p = ::strchr(FT8_C38, full[i]);
+				if ( ! p || ! full[i])
+					return false;
+				n58 = (n58 * 38) + (p - FT8_C38);
+			}
+			CallHashes::instance().add(full);
+
+			Packer77 bits(payload);
+			bits.write(icq ? 0 : CallHashes::hash(hashed, 12), 12);
+			bits.write(n58, 58);
+			bits.write(iflip, 1);
+			bits.write(nrpt, 2);
+			bits.write(icq, 1);
+			bits.write(4, 3);
+			return true;
+		}
+
+
+		//
+		//  pack77_text(...) - type 0.0: up to 13 characters of free text;
+		//     longer messages are cut short, as WSJT-X does
+		//
+		inline bool pack77_text(const std::string &msg, uint8_t *payload) {
+			std::string text = msg.substr(0, 13);
+			text.resize(13, ' ');
+			unsigned __int128 n = 0;
+			for (size_t i = 0; i != text.size(); ++i) {
+				const char *p = ::strchr(FT8_C42, text[i]);
+				if ( ! p || ! text[i])
+					return false;
+				n = (n * 42) + (p - FT8_C42);
+			}
+
+			Packer77 bits(payload);
+			bits.write(static_cast<uint64_t>(n >> 64), 7);
+			bits.write(static_cast<uint64_t>(n), 64);
+			bits.write(0, 3); // n3
+			bits.write(0, 3); // i3
+			return true;
+		}
+
+
+		//
+		//  pack77(...) - pack a message into a 77-bit payload (10 bytes,
+		//     most significant bit first); returns false if the message
+		//     can't be sent
+		//
+		inline bool pack77(const std::string &message, uint8_t *payload) {
+			// upper case, single spaces
+			std::vector<std::string> words;
+			std::string msg, word;
+			const std::string upper = my::toUpper(message);
+			for (size_t i = 0; i <= upper.size(); ++i) {
+				if (i == upper.size() || isspace(upper[i])) {
+					if ( ! word.empty()) {
+						words.push_back(word);
+						msg += (msg.empty() ? "" : " ") + word;
+						word.clear();
+					}
+				} else {
+					word += upper[i];
+				}
+			}
+			if (words.empty())
+				return false;
+
+			// 'CQ DX K1ABC FN42' is sent with 'CQ_DX' as one call
+			std::vector<std::string> calls(words);
+			if (calls.size() >= 3 && calls[0] == "CQ" &&
+					((calls[1].size() == 3 && my::isDigit(calls[1])) ||
+					 (calls[1].size() <= 4 && my::isUpper(calls[1])))) {
+				calls[1] = "CQ_" + calls[1];
+				calls.erase(calls.begin());
+			}
+
+			if (pack77_std(calls, payload))
+				return true;
+			if (pack77_nonstd(words, payload))
+				return true;
+			return pack77_text(msg, payload);
+		}
+	}
+}
+
+#endif // __KK5JY_FT8_MSG_H
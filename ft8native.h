@@ -0,0 +1,525 @@
+/*
+ *
+ *
+ *    ft8native.h
+ *
+ *    In-process FT8/FT4 decoder, used in place of 'jt9'.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    The samples are turned into a waterfall of tone powers with a quarter
+ *    symbol of time resolution and half a tone of frequency resolution.
+ *    Candidates are found by how well the Costas sync tones stand out from
+ *    their neighbours; each candidate is then demapped to soft bits, run
+ *    through the LDPC decoder, and checked against its CRC.  Candidates are
+ *    shared out to a pool of threads.
+ *
+ *    Unlike 'jt9', there is no signal subtraction (a second pass for the
+ *    signals hidden under stronger ones) and no ordered-statistics
+ *    decoding, so the weakest decodes are missed.  The SNR is estimated
+ *    from the waterfall, and is only approximately the value 'jt9' reports.
+ *
+ */
+
+#ifndef __KK5JY_FT8_NATIVE_H
+#define __KK5JY_FT8_NATIVE_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "fft.h"
+#include "ft8ldpc.h"
+#include "ft8msg.h"
+#include "encode.h"
+#include "locker.h"
+#include "IDecodeSink.h"
+
+namespace KK5JY {
+	namespace FT8 {
+		// decoder threads per decode; zero means the share of the online
+		//    CPUs the caller passes in (or all of them)
+		#ifndef KK5JY_NATIVE_THREADS
+		#define KK5JY_NATIVE_THREADS (0)
+		#endif
+
+		// waterfall resolution: frames per symbol, and bins per tone
+		const int NATIVE_TIME_OSR = 4;
+		const int NATIVE_FREQ_OSR = 2;
+
+
+		//
+		//  struct NativeMode - the shape of an FT8 or FT4 transmission
+		//
+		struct NativeMode {
+			bool ft4;
+			int nsps;        // samples per symbol, at 12kHz
+			int tones;       // 8 or 4
+			int bits;        // bits per symbol
+			int symbols;     // total symbols, sync included
+			int syncBlocks;  // Costas arrays
+			int syncLength;  // symbols in each
+			int syncSpacing; // symbols from one to the next
+			int syncFirst;   // symbol index of the first
+			double dtMin;    // time offsets searched (s)
+			double dtMax;
+
+			NativeMode(bool isFT4) : ft4(isFT4) {
+				if (ft4) {
+					nsps = 576; tones = 4; bits = 2; symbols = 105;
+					syncBlocks = 4; syncLength = 4; syncSpacing = 33; syncFirst = 1;
+					dtMin = -1.0; dtMax = 1.0;
+				} else {
+					nsps = 1920; tones = 8; bits = 3; symbols = 79;
+					syncBlocks = 3; syncLength = 7; syncSpacing = 36; syncFirst = 0;
+					dtMin = -2.0; dtMax = 2.5;
+				}
+			}
+
+			// the Costas tone for symbol 'k' of sync block 'block'
+			int costas(int block, int k) const {
+				return ft4 ? FT4_COSTAS[block][k] : FT8_COSTAS[k];
+			}
+
+			// the symbol index of data symbol 'k'
+			int dataSymbol(int k) const {
+				if (ft4)
+					return k + (k < 29 ? 5 : (k < 58 ? 9 : 13));
+				return k + (k < 29 ? 7 : 14);
+			}
+
+			// the tone for a Gray-coded symbol value
+			int gray(int value) const {
+				return ft4 ? FT4_GRAY[value] : FT8_GRAY[value];
+			}
+		};
+
+
+		//
+		//  struct NativeCandidate - a possible signal from the sync search
+		//
+		struct NativeCandidate {
+			float score; // mean sync tone advantage (dB)
+			int frame;   // waterfall frame of the first symbol
+			int bin;     // waterfall bin of the lowest tone
+
+			bool operator<(const NativeCandidate &other) const {
+				return score > other.score; // best first
+			}
+		};
+
+
+		//
+		//  class NativeDecoder - one decode of one slot
+		//
+		class NativeDecoder {
+			private:
+				NativeMode m_Mode;
+				int m_Depth;
+				double m_Start;
+				IDecodeSink &m_Sink;
+
+				// the waterfall: power in dB, frame-major
+				int m_Frames;
+				int m_Bins;
+				int m_Hop;
+				std::vector<float> m_Power;
+				double m_Noise; // mean power of a bin with no signal
+
+				// the search
+				int m_LowBin, m_HighBin;
+				std::vector<NativeCandidate> m_Candidates;
+				std::atomic<size_t> m_Next;
+
+				// results
+				my::mutex m_Lock;
+				std::set<std::string> m_Payloads; // decoded already
+				size_t m_Decodes;
+
+				// the waterfall bin spacing (Hz)
+				double binWidth() const { return 12000.0 / (NATIVE_FREQ_OSR * m_Mode.nsps); }
+
+				// the power of a bin, or zero outside the capture
+				float power(int frame, int bin) const {
+					if (frame < 0 || frame >= m_Frames)
+						return 0.0f;
+					return m_Power[frame * m_Bins + bin];
+				}
+
+				void waterfall(const int16_t *samples, size_t count);
+				float syncScore(int frame, int bin) const;
+				void search();
+				void decode(const NativeCandidate &cand);
+
+				static void *worker(void *parent);
+
+			public:
+				NativeDecoder(const std::string &mode, short depth, double start, IDecodeSink &sink);
+
+				// decode 12kHz samples, handing each message to the sink,
+				//    on up to 'threads' threads (0 = one per CPU); returns
+				//    the number of messages decoded
+				size_t run(const int16_t *samples, size_t count, int low, int high, size_t threads = 0);
+		};
+
+
+		//
+		//  NativeDecoder::ctor
+		//
+		inline NativeDecoder::NativeDecoder(const std::string &mode, short depth, double start, IDecodeSink &sink)
+			: m_Mode(mode == "ft4"), m_Depth(depth), m_Start(start), m_Sink(sink),
+			  m_Frames(0), m_Bins(0), m_Hop(0), m_Noise(0), m_LowBin(0), m_HighBin(0), m_Next(0), m_Decodes(0) {
+			if (m_Depth < 1)
+				m_Depth = 1;
+			else if (m_Depth > 3)
+				m_Depth = 3;
+		}
+
+
+		//
+		//  NativeDecoder::waterfall(...) - Hann-windowed FFTs two symbols
+		//     long, NATIVE_TIME_OSR per symbol; frame 'f' is centred on the
+		//     middle of a symbol that starts at sample f * m_Hop
+		//
+		inline void NativeDecoder::waterfall(const int16_t *samples, size_t count) {
+			typedef DSP::FFT<float>::complex_t complex_t;
+			const int nfft = NATIVE_FREQ_OSR * m_Mode.nsps;
+			DSP::FFT<float> fft(nfft);
+
+			std::vector<float> window(nfft);
+			for (int i = 0; i != nfft; ++i)
+				window[i] = (0.5 - 0.5 * std::cos(2.0 * M_PI * i / nfft)) / 32768.0;
+
+			m_Hop = m_Mode.nsps / NATIVE_TIME_OSR;
+			m_Frames = static_cast<int>(count / m_Hop);
+			m_Power.assign(static_cast<size_t>(m_Frames) * m_Bins, 0.0f);
+
+			std::vector<complex_t> in(nfft), out(nfft);
+			for (int f = 0; f != m_Frames; ++f) {
+				const long first = static_cast<long>(f) * m_Hop + ((m_Mode.nsps - nfft) / 2);
+				for (int i = 0; i != nfft; ++i) {
+					const long idx = first + i;
+					float s = (idx >= 0 && idx < static_cast<long>(count)) ? samples[idx] : 0;
+					in[i] = complex_t(s * window[i], 0);
+				}
+				fft.forward(&in[0], &out[0]);
+
+				float *row = &m_Power[static_cast<size_t>(f) * m_Bins];
+				for (int b = 0; b != m_Bins; ++b)
+					row[b] = 10.0f * std::log10(std::norm(out[b]) + 1e-12f);
+			}
+
+			// the noise floor: the power of a noise-only bin is exponentially
+			//    distributed, with a median of ln(2) times its mean; most of
+			//    the bins in the search band hold no signal
+			std::vector<float> band;
+			band.reserve(static_cast<size_t>(m_Frames) * (m_HighBin - m_LowBin + 1));
+			for (int f = 0; f != m_Frames; ++f)
+				for (int b = m_LowBin; b <= m_HighBin; ++b)
+					band.push_back(m_Power[static_cast<size_t>(f) * m_Bins + b]);
+			if ( ! band.empty()) {
+				std::nth_element(band.begin(), band.begin() + band.size() / 2, band.end());
+				m_Noise = std::pow(10.0, band[band.size() / 2] / 10.0) / std::log(2.0);
+			}
+		}
+
+
+		//
+		//  NativeDecoder::syncScore(...) - how far the sync tones stand out
+		//     from the tones either side of them, in frequency and in time
+		//
+		inline float NativeDecoder::syncScore(int frame, int bin) const {
+			float score = 0;
+			int count = 0;
+			for (int block = 0; block != m_Mode.syncBlocks; ++block) {
+				for (int k = 0; k != m_Mode.syncLength; ++k) {
+					const int sym = m_Mode.syncFirst + (block * m_Mode.syncSpacing) + k;
+					const int t = frame + (NATIVE_TIME_OSR * sym);
+					if (t < 0 || t >= m_Frames)
+						continue;
+					const int tone = m_Mode.costas(block, k);
+					const int b = bin + (NATIVE_FREQ_OSR * tone);
+					const float p = power(t, b);
+
+					if (tone > 0) {
+						score += p - power(t, b - 2);
+						++count;
+					}
+					if (tone < m_Mode.tones - 1) {
+						score += p - power(t, b + 2);
+						++count;
+					}
+					if (k > 0 && t >= NATIVE_TIME_OSR) {
+						score += p - power(t - NATIVE_TIME_OSR, b);
+						++count;
+					}
+					if (k < m_Mode.syncLength - 1 && t + NATIVE_TIME_OSR < m_Frames) {
+						score += p - power(t + NATIVE_TIME_OSR, b);
+						++count;
+					}
+				}
+			}
+			return count ? score / count : 0;
+		}
+
+
+		//
+		//  NativeDecoder::search() - keep the best local maxima of the sync
+		//     score as candidates
+		//
+		inline void NativeDecoder::search() {
+			const int frameMin = static_cast<int>(std::floor((m_Mode.dtMin + 0.5) * 12000 / m_Hop));
+			const int frameMax = static_cast<int>(std::ceil((m_Mode.dtMax + 0.5) * 12000 / m_Hop));
+			const int frames = frameMax - frameMin + 1;
+			const int bins = m_HighBin - m_LowBin + 1;
+			if (bins <= 0)
+				return;
+
+			std::vector<float> scores(static_cast<size_t>(frames) * bins);
+			for (int f = 0; f != frames; ++f)
+				for (int b = 0; b != bins; ++b)
+					scores[f * bins + b] = syncScore(f + frameMin, b + m_LowBin);
+
+			const float minScore = 2.0f;
+			for (int f = 0; f != frames; ++f) {
+				for (int b = 0; b != bins; ++b) {
+					const float s = scores[f * bins + b];
+					if (s < minScore)
+						continue;
+
+					// must be the best of its neighbours
+					bool peak = true;
+					for (int df = -1; df <= 1 && peak; ++df) {
+						for (int db = -1; db <= 1 && peak; ++db) {
+							const int ff = f + df, bb = b + db;
+							if ((df || db) && ff >= 0 && ff < frames && bb >= 0 && bb < bins)
+								peak = scores[ff * bins + bb] <= s;
+						}
+					}
+					if ( ! peak)
+						continue;
+
+					NativeCandidate c;
+					c.score = s;
+					c.frame = f + frameMin;
+					c.bin = b + m_LowBin;
+					m_Candidates.push_back(c);
+				}
+			}
+
+			// keep the strongest, more of them at higher depths
+			const size_t limits[] = { 100, 150, 200 };
+			std::sort(m_Candidates.begin(), m_Candidates.end());
+			if (m_Candidates.size() > limits[m_Depth - 1])
+				m_Candidates.resize(limits[m_Depth - 1]);
+		}
+
+
+		//
+		//  NativeDecoder::decode(...) - demap, correct and unpack one
+		//     candidate
+		//
+		inline void NativeDecoder::decode(const NativeCandidate &cand) {
+			const int dataSymbols = LDPC_N / m_Mode.bits;
+			float llr[LDPC_N];
+			float s2[8];
+
+			// soft bits: for each bit, the strongest tone that would make
+			//    it a one, less the strongest that would make it a zero;
+			//    amplitudes do better than dB here for weak signals
+			for (int k = 0; k != dataSymbols; ++k) {
+				const int t = cand.frame + (NATIVE_TIME_OSR * m_Mode.dataSymbol(k));
+				for (int j = 0; j != m_Mode.tones; ++j)
+					s2[j] = std::pow(10.0f, power(t, cand.bin + (NATIVE_FREQ_OSR * m_Mode.gray(j))) / 20.0f);
+				for (int bit = 0; bit != m_Mode.bits; ++bit) {
+					const int mask = 1 << (m_Mode.bits - 1 - bit);
+					float one = -1e30f, zero = -1e30f;
+					for (int j = 0; j != m_Mode.tones; ++j) {
+						if (j & mask)
+							one = std::max(one, s2[j]);
+						else
+							zero = std::max(zero, s2[j]);
+					}
+					llr[(k * m_Mode.bits) + bit] = one - zero;
+				}
+			}
+
+			// scale to unit-ish variance, as the LDPC decoder expects
+			double sum = 0, sum2 = 0;
+			for (int i = 0; i != LDPC_N; ++i) {
+				sum += llr[i];
+				sum2 += llr[i] * llr[i];
+			}
+			const double mean = sum / LDPC_N;
+			const double variance = (sum2 / LDPC_N) - (mean * mean);
+			if (variance <= 0)
+				return;
+			const float norm = static_cast<float>(std::sqrt(24.0 / variance));
+			for (int i = 0; i != LDPC_N; ++i)
+				llr[i] *= norm;
+
+			// error correction
+			const int iterations[] = { 20, 30, 50 };
+			uint8_t codeword[LDPC_N];
+			if (ldpc_decode(llr, iterations[m_Depth - 1], codeword) != 0)
+				return;
+			bool zero = true;
+			for (int i = 0; i != LDPC_N && zero; ++i)
+				zero = (codeword[i] == 0);
+			if (zero)
+				return;
+			uint8_t payload[10];
+			if ( ! ft8_check_crc(codeword, payload))
+				return;
+			if (m_Mode.ft4) {
+				for (int i = 0; i != 10; ++i)
+					payload[i] ^= FT4_XOR[i];
+				payload[9] &= 0xF8;
+			}
+
+			// the same signal is often found at neighbouring candidates
+			{
+				my::locker lock(m_Lock);
+				if ( ! m_Payloads.insert(std::string(reinterpret_cast<char*>(payload), 10)).second)
+					return;
+			}
+
+			const std::string text = unpack77(payload);
+			if (text.empty())
+				return;
+
+			// SNR: the transmitted tones against the noise floor, scaled
+			//    from the bin's noise bandwidth (1.5 bins for Hann) to 2500Hz;
+			//    the window spans the neighbouring symbols too, which costs
+			//    the tone about 2dB
+			double sig = 0;
+			int sigCount = 0;
+			for (int k = 0; k != dataSymbols; ++k) {
+				const int t = cand.frame + (NATIVE_TIME_OSR * m_Mode.dataSymbol(k));
+				if (t < 0 || t >= m_Frames)
+					continue;
+				int value = 0;
+				for (int bit = 0; bit != m_Mode.bits; ++bit)
+					value = (value << 1) | codeword[(k * m_Mode.bits) + bit];
+				sig += std::pow(10.0, power(t, cand.bin + (NATIVE_FREQ_OSR * m_Mode.gray(value))) / 10.0);
+				++sigCount;
+			}
+			int snr = -24;
+			if (sigCount && m_Noise > 0) {
+				const double ratio = (sig / sigCount) / m_Noise - 1.0;
+				if (ratio > 0)
+					snr = static_cast<int>(::lrint(10.0 * std::log10(ratio) +
+						10.0 * std::log10(1.5 * binWidth() / 2500.0) + 2.0));
+			}
+			snr = std::max(-24, std::min(30, snr));
+
+			// format the line the way 'jt9' does
+			const double dt = (static_cast<double>(cand.frame) * m_Hop / 12000.0) - 0.5;
+			const int freq = static_cast<int>(::lrint(cand.bin * binWidth()));
+			time_t when = static_cast<time_t>(m_Start + 0.5);
+			struct tm utc;
+			::gmtime_r(&when, &utc);
+			char line[128];
+			snprintf(line, sizeof(line), "%02d%02d%02d%4d%5.1f%5d %c  %s",
+				utc.tm_hour, utc.tm_min, utc.tm_sec, snr, dt, freq,
+				m_Mode.ft4 ? '+' : '~', text.c_str());
+
+			{
+				my::locker lock(m_Lock);
+				++m_Decodes;
+			}
+			m_Sink.decoded(m_Start, line);
+		}
+
+
+		//
+		//  NativeDecoder::worker(...) - decode candidates until none are left
+		//
+		inline void *NativeDecoder::worker(void *parent) {
+			NativeDecoder *self = reinterpret_cast<NativeDecoder*>(parent);
+			size_t i;
+			while ((i = self->m_Next++) < self->m_Candidates.size())
+				self->decode(self->m_Candidates[i]);
+			return 0;
+		}
+
+
+		//
+		//  NativeDecoder::run(...)
+		//
+		inline size_t NativeDecoder::run(const int16_t *samples, size_t count, int low, int high, size_t cpus) {
+			if (high <= low) {
+				low = 200;
+				high = 3000;
+			}
+
+			// bins needed for the highest tone of the highest signal
+			const double width = 12000.0 / (NATIVE_FREQ_OSR * m_Mode.nsps);
+			m_LowBin = std::max(1, static_cast<int>(low / width));
+			m_HighBin = static_cast<int>(high / width);
+			m_Bins = m_HighBin + (NATIVE_FREQ_OSR * m_Mode.tones) + 1;
+			if (m_Bins > m_Mode.nsps)
+				m_Bins = m_Mode.nsps;
+			m_HighBin = std::min(m_HighBin, m_Bins - (NATIVE_FREQ_OSR * m_Mode.tones));
+
+			if ( ! samples || count < static_cast<size_t>(m_Mode.nsps))
+				return 0;
+			waterfall(samples, count);
+			search();
+
+			// share the candidates out
+			long threads = KK5JY_NATIVE_THREADS;
+			if (threads <= 0)
+				threads = static_cast<long>(cpus);
+			if (threads <= 0)
+				threads = ::sysconf(_SC_NPROCESSORS_ONLN);
+			if (threads <= 0)
+				threads = 1;
+			if (static_cast<size_t>(threads) > m_Candidates.size())
+				threads = m_Candidates.size();
+
+			std::vector<pthread_t> ids;
+			for (long i = 1; i < threads; ++i) {
+				pthread_t id;
+				if (pthread_create(&id, 0, worker, this) == 0)
+					ids.push_back(id);
+			}
+			worker(this);
+			for (size_t i = 0; i != ids.size(); ++i)
+				pthread_join(ids[i], 0);
+
+			return m_Decodes;
+		}
+
+
+		//
+		//  native_decode(...) - decode 12kHz samples in-process; takes the
+		//     same arguments as Jt9Server::decode(...)
+		//
+		inline bool native_decode(
+				const std::string &mode,
+				short depth,
+				double start,
+				const int16_t *samples,
+				size_t count,
+				IDecodeSink &sink,
+				int low = 0,
+				int high = 0,
+				size_t threads = 0) {
+			NativeDecoder decoder(mode, depth, start, sink);
+			decoder.run(samples, count, low, high, threads);
+			return true;
+		}
+	}
+}
+
+#endif // __KK5JY_FT8_NATIVE_H
@@ -0,0 +1,718 @@
+/*
+ *
+ *
+ *    jt9shm.h
+ *
+ *    Persistent 'jt9' decoder using its shared memory ('-s') interface.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    'jt9 -s <key>' attaches to a Qt shared memory segment holding the
+ *    WSJT-X 'dec_data' block, then loops: it sleeps while '<tmp>/.lock'
+ *    exists, decodes the samples and parameters in the segment, prints the
+ *    decodes followed by a '<DecodeFinished>' line, and recreates the lock
+ *    file.  It exits when '<tmp>/.quit' exists.  This module plays the part
+ *    of the WSJT-X GUI in that exchange, so each 'jt9' process (with its FFTW
+ *    plans) serves many slots.
+ *
+ *    The segment layout follows 'commons.h' from WSJT-X 2.5/2.6; other
+ *    releases may differ.  The key files follow Qt 5's SysV naming rules.
+ *
+ */
+
+#ifndef __KK5JY_FT8_JT9SHM_H
+#define __KK5JY_FT8_JT9SHM_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <time.h>
+
+// process and IPC support
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <dirent.h>
+#include <pthread.h>
+
+// string operations
+#include "stype.h"
+
+// mutex locking
+#include "locker.h"
+
+// decode line receiver
+#include "IDecodeSink.h"
+
+#include <iostream>
+
+// WSJT-X 'commons.h' dimensions
+#define KK5JY_JT9_NSMAX (6827)
+#define KK5JY_JT9_NTMAX (30 * 60)
+#define KK5JY_JT9_RATE  (12000)
+
+// the line 'jt9' prints after each decode pass in shared memory mode
+#define KK5JY_JT9_FINISHED "<DecodeFinished>"
+
+namespace KK5JY {
+	namespace FT8 {
+		//
+		//  struct Jt9Params - the 'params' block of WSJT-X 'dec_data'
+		//
+		struct Jt9Params {
+			int32_t nutc;         // UTC as integer, HHMMSS
+			bool ndiskdat;        // true ==> data read from *.wav file
+			int32_t ntrperiod;    // TR period (seconds)
+			int32_t nQSOProgress; // QSO state machine state
+			int32_t nfqso;        // user-selected QSO freq (Hz)
+			int32_t nftx;         // TX audio offset
+			bool newdat;          // true ==> new data
+			int32_t npts8;
+			int32_t nfa;          // low decode limit (Hz)
+			int32_t nfSplit;
+			int32_t nfb;          // high decode limit (Hz)
+			int32_t ntol;         // +/- decoding range around nfqso (Hz)
+			int32_t kin;          // number of samples in 'd2'
+			int32_t nzhsym;
+			int32_t nsubmode;
+			bool nagain;
+			int32_t ndepth;
+			bool lft8apon;
+			bool lapcqonly;
+			bool ljt65apon;
+			int32_t napwid;
+			int32_t ntxmode;
+			int32_t nmode;        // 8 = FT8, 5 = FT4
+			int32_t minw;
+			bool nclearave;
+			int32_t minSync;
+			float emedelay;
+			float dttol;
+			int32_t nlist;
+			int32_t listutc[10];
+			int32_t n2pass;
+			int32_t nranera;
+			int32_t naggressive;
+			bool nrobust;
+			int32_t nexp_decode;
+			int32_t max_drift;
+			char datetime[20];
+			char mycall[12];
+			char mygrid[6];
+			char hiscall[12];
+			char hisgrid[6];
+		};
+
+
+		//
+		//  struct Jt9SharedData - WSJT-X 'dec_data'
+		//
+		struct Jt9SharedData {
+			float ss[184 * KK5JY_JT9_NSMAX];
+			float savg[KK5JY_JT9_NSMAX];
+			float sred[5760];
+			int16_t d2[KK5JY_JT9_NTMAX * KK5JY_JT9_RATE];
+			Jt9Params params;
+		};
+
+
+		//
+		//  sha1_hex(...) - SHA-1 digest of 's' as lowercase hex
+		//
+		inline std::string sha1_hex(const std::string &s) {
+			uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+			// pad the message
+			std::string msg(s);
+			uint64_t bits = static_cast<uint64_t>(s.size()) * 8;
+			msg += static_cast<char>(0x80);
+			while ((msg.size() % 64) != 56)
+				msg += static_cast<char>(0);
+			for (int i = 7; i >= 0; --i)
+				msg += static_cast<char>((bits >> (i * 8)) & 0xFF);
+
+			// process each block
+			for (size_t blk = 0; blk != msg.size(); blk += 64) {
+				uint32_t w[80];
+				for (int i = 0; i != 16; ++i) {
+					const unsigned char *p = reinterpret_cast<const unsigned char*>(msg.data() + blk + (4 * i));
+					w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+				}
+				for (int i = 16; i != 80; ++i) {
+					uint32_t t = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+					w[i] = (t << 1) | (t >> 31);
+				}
+
+				uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+				for (int i = 0; i != 80; ++i) {
+					uint32_t f, k;
+					if (i < 20) {
+						f = (b & c) | (~b & d); k = 0x5A827999;
+					} else if (i < 40) {
+						f = b ^ c ^ d; k = 0x6ED9EBA1;
+					} else if (i < 60) {
+						f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC;
+					} else {
+						f = b ^ c ^ d; k = 0xCA62C1D6;
+					}
+					uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+					e = d; d = c; c = (b << 30) | (b >> 2); b = a; a = t;
+				}
+				h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+			}
+
+			char hex[41];
+			for (int i = 0; i != 5; ++i)
+				snprintf(hex + (8 * i), 9, "%08x", h[i]);
+			return std::string(hex, 40);
+		}
+
+
+		//
+		//  jt9_temp_path() - Qt's idea of the temp folder
+		//
+		inline std::string jt9_temp_path() {
+			const char *tmp = getenv("TMPDIR");
+			std::string result = (tmp && *tmp) ? tmp : "/tmp";
+			while (result.size() > 1 && result[result.size() - 1] == '/')
+				result.erase(result.size() - 1);
+			return result;
+		}
+
+
+		//
+		//  jt9_native_key(...) - the key file Qt 5 derives from a shared memory key
+		//
+		inline std::string jt9_native_key(const std::string &key) {
+			std::string result = jt9_temp_path() + "/qipc_sharedmemory_";
+			for (std::string::const_iterator i = key.begin(); i != key.end(); ++i) {
+				if ((*i >= 'a' && *i <= 'z') || (*i >= 'A' && *i <= 'Z'))
+					result += *i;
+			}
+			return result + sha1_hex(key);
+		}
+
+
+		//
+		//  class Jt9SharedMemory - the SysV segment shared with 'jt9'
+		//
+		class Jt9SharedMemory {
+			private:
+				std::string m_KeyFile;
+				int m_ID;
+				bool m_Owner;
+				Jt9SharedData *m_Data;
+
+			private: // disallowed
+				Jt9SharedMemory(const Jt9SharedMemory&);
+				Jt9SharedMemory &operator=(const Jt9SharedMemory&);
+
+			public:
+				Jt9SharedMemory() : m_ID(-1), m_Owner(false), m_Data(0) { /* nop */ }
+				~Jt9SharedMemory() { detach(); }
+
+				// create a new segment for 'key' (host side)
+				void create(const std::string &key);
+
+				// attach to an existing segment for 'key' (decoder side)
+				void attach(const std::string &key);
+
+				// detach, and remove the segment if this side created it
+				void detach();
+
+				// the shared data
+				Jt9SharedData *data() const { return m_Data; }
+		};
+
+
+		//
+		//  Jt9SharedMemory::create(...)
+		//
+		inline void Jt9SharedMemory::create(const std::string &key) {
+			detach();
+			m_KeyFile = jt9_native_key(key);
+
+			// Qt derives the SysV key from this file
+			int fd = ::open(m_KeyFile.c_str(), O_CREAT | O_WRONLY, 0600);
+			if (fd < 0)
+				throw std::runtime_error("Could not create shared memory key file: " + m_KeyFile);
+			::close(fd);
+
+			key_t ipc = ::ftok(m_KeyFile.c_str(), 'Q');
+			if (ipc == -1)
+				throw std::runtime_error("Could not derive shared memory key");
+
+			// remove any stale segment left by a crashed run
+			m_ID = ::shmget(ipc, sizeof(Jt9SharedData), 0600 | IPC_CREAT | IPC_EXCL);
+			if (m_ID == -1 && errno == EEXIST) {
+				int old = ::shmget(ipc, 0, 0600);
+				if (old != -1)
+					::shmctl(old, IPC_RMID, 0);
+				m_ID = ::shmget(ipc, sizeof(Jt9SharedData), 0600 | IPC_CREAT | IPC_EXCL);
+			}
+			if (m_ID == -1)
+				throw std::runtime_error("Could not create shared memory segment");
+			m_Owner = true;
+
+			void *p = ::shmat(m_ID, 0, 0);
+			if (p == reinterpret_cast<void*>(-1)) {
+				detach();
+				throw std::runtime_error("Could not attach shared memory segment");
+			}
+			m_Data = reinterpret_cast<Jt9SharedData*>(p);
+		}
+
+
+		//
+		//  Jt9SharedMemory::attach(...)
+		//
+		inline void Jt9SharedMemory::attach(const std::string &key) {
+			detach();
+			m_KeyFile = jt9_native_key(key);
+
+			key_t ipc = ::ftok(m_KeyFile.c_str(), 'Q');
+			if (ipc == -1)
+				throw std::runtime_error("Shared memory key file not found: " + m_KeyFile);
+			m_ID = ::shmget(ipc, 0, 0600);
+			if (m_ID == -1)
+				throw std::runtime_error("Shared memory segment not found");
+
+			void *p = ::shmat(m_ID, 0, 0);
+			if (p == reinterpret_cast<void*>(-1)) {
+				m_ID = -1;
+				throw std::runtime_error("Could not attach shared memory segment");
+			}
+			m_Data = reinterpret_cast<Jt9SharedData*>(p);
+		}
+
+
+		//
+		//  Jt9SharedMemory::detach()
+		//
+		inline void Jt9SharedMemory::detach() {
+			if (m_Data) {
+				::shmdt(m_Data);
+				m_Data = 0;
+			}
+			if (m_Owner) {
+				if (m_ID != -1)
+					::shmctl(m_ID, IPC_RMID, 0);
+				::unlink(m_KeyFile.c_str());
+				m_Owner = false;
+			}
+			m_ID = -1;
+		}
+
+
+		//
+		//  jt9_binary() - the 'jt9' executable; 'KK5JY_JT9' overrides it
+		//
+		inline std::string jt9_binary() {
+			const char *bin = getenv("KK5JY_JT9");
+			return (bin && *bin) ? bin : "jt9";
+		}
+
+
+		// the most 'jt9' processes kept for concurrent decodes
+		#ifndef KK5JY_JT9_SERVERS
+		#define KK5JY_JT9_SERVERS (8)
+		#endif
+
+		//
+		//  class Jt9Server - one persistent 'jt9' process; a small pool of
+		//     them lets decodes run concurrently
+		//
+		class Jt9Server {
+			private:
+				my::mutex m_Mutex;      // one decode at a time
+				Jt9SharedMemory m_Shm;
+				std::string m_Key;
+				std::string m_Dir;      // private temp folder for the handshake files
+				pid_t m_Child;
+				int m_Pipe;             // child's stdout
+				std::string m_Pending;  // partial line from the child
+
+			private: // disallowed
+				Jt9Server(const Jt9Server&);
+				Jt9Server &operator=(const Jt9Server&);
+
+			private:
+				Jt9Server(size_t index);
+
+				// the pool of idle servers
+				struct Pool {
+					my::mutex lock;
+					my::condition idle;
+					std::vector<Jt9Server*> all;
+					std::vector<Jt9Server*> free;
+					~Pool();
+				};
+				static Pool &pool();
+
+				// start 'jt9' if it isn't running
+				bool launch();
+
+				// stop 'jt9' and clean up
+				void stop();
+
+				// read one line of 'jt9' output; false at EOF
+				bool readLine(std::string &line);
+
+				// handshake file helpers
+				std::string lockFile() const { return m_Dir + "/.lock"; }
+				std::string quitFile() const { return m_Dir + "/.quit"; }
+				static bool exists(const std::string &path) { return ::access(path.c_str(), F_OK) == 0; }
+				static void touch(const std::string &path) {
+					int fd = ::open(path.c_str(), O_CREAT | O_WRONLY, 0600);
+					if (fd >= 0) ::close(fd);
+				}
+
+			public:
+				~Jt9Server();
+
+				// take an idle server from the pool, starting a new one if
+				//    fewer than KK5JY_JT9_SERVERS exist; otherwise waits
+				static Jt9Server *acquire();
+
+				// return a server to the pool
+				static void release(Jt9Server *server);
+
+				//
+				//  decode 12kHz samples; hands each decode line to 'sink' as
+				//     soon as 'jt9' prints it; returns false if 'jt9' could not
+				//     be run; 'low' and 'high' limit the signal frequencies
+				//     searched (Hz), unless zero
+				//
+				bool decode(
+					const std::string &mode,
+					short depth,
+					double start,
+					const int16_t *samples,
+					size_t count,
+					IDecodeSink &sink,
+					int low = 0,
+					int high = 0);
+		};
+
+
+		//
+		//  Jt9Server::ctor
+		//
+		inline Jt9Server::Jt9Server(size_t index) : m_Child(-1), m_Pipe(-1) {
+			char key[64];
+			snprintf(key, sizeof(key), "ft8modem-%d-%u",
+				static_cast<int>(::getpid()), static_cast<unsigned>(index));
+			m_Key = key;
+		}
+
+
+		//
+		//  Jt9Server::dtor
+		//
+		inline Jt9Server::~Jt9Server() {
+			stop();
+
+			// remove the work folder and whatever jt9 left in it
+			if ( ! m_Dir.empty()) {
+				DIR *dir = ::opendir(m_Dir.c_str());
+				if (dir) {
+					struct dirent *ent;
+					while ((ent = ::readdir(dir)) != 0) {
+						std::string name = ent->d_name;
+						if (name != "." && name != "..")
+							::unlink((m_Dir + "/" + name).c_str());
+					}
+					::closedir(dir);
+				}
+				::rmdir(m_Dir.c_str());
+			}
+		}
+
+
+		//
+		//  Jt9Server::Pool::dtor - stop every 'jt9' at exit
+		//
+		inline Jt9Server::Pool::~Pool() {
+			for (size_t i = 0; i != all.size(); ++i)
+				delete all[i];
+		}
+
+
+		//
+		//  Jt9Server::pool()
+		//
+		inline Jt9Server::Pool &Jt9Server::pool() {
+			static Pool thePool;
+			return thePool;
+		}
+
+
+		//
+		//  Jt9Server::acquire()
+		//
+		inline Jt9Server *Jt9Server::acquire() {
+			Pool &p = pool();
+			my::locker lock(p.lock);
+			while (p.free.empty()) {
+				if (p.all.size() < KK5JY_JT9_SERVERS) {
+					Jt9Server *server = new Jt9Server(p.all.size());
+					p.all.push_back(server);
+					return server;
+				}
+				p.idle.wait(p.lock);
+			}
+			Jt9Server *server = p.free.back();
+			p.free.pop_back();
+			return server;
+		}
+
+
+		//
+		//  Jt9Server::release(...)
+		//
+		inline void Jt9Server::release(Jt9Server *server) {
+			if ( ! server)
+				return;
+			Pool &p = pool();
+			my::locker lock(p.lock);
+			p.free.push_back(server);
+			p.idle.signal();
+		}
+
+
+		//
+		//  Jt9Server::launch()
+		//
+		inline bool Jt9Server::launch() {
+			if (m_Child > 0) {
+				// still alive?
+				if (::waitpid(m_Child, 0, WNOHANG) == 0)
+					return true;
+				std::cerr << "WARN: jt9 exited; restarting" << std::endl;
+				m_Child = -1;
+				stop();
+			}
+
+			try {
+				// private folder for the .lock/.quit handshake and jt9's own files
+				if (m_Dir.empty()) {
+					std::string tmpl = jt9_temp_path() + "/ft8modem.XXXXXX";
+					std::vector<char> buf(tmpl.begin(), tmpl.end());
+					buf.push_back(0);
+					if ( ! ::mkdtemp(&buf[0]))
+						throw std::runtime_error("Could not create jt9 work folder");
+					m_Dir = &buf[0];
+				}
+				::unlink(quitFile().c_str());
+				touch(lockFile()); // hold jt9 until there is data
+
+				m_Shm.create(m_Key);
+			} catch (const std::exception &ex) {
+				std::cerr << "ERR: " << ex.what() << std::endl;
+				return false;
+			}
+
+			int fds[2];
+			if (::pipe(fds) != 0)
+				return false;
+			::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+			std::string bin = jt9_binary();
+			// jt9 is Fortran; keep its stdout from being block-buffered
+			::setenv("GFORTRAN_UNBUFFERED_PRECONNECTED", "y", 0);
+
+			pid_t pid = ::fork();
+			if (pid < 0) {
+				::close(fds[0]);
+				::close(fds[1]);
+				return false;
+			}
+			if (pid == 0) {
+				// child: stdout to the pipe, then become jt9
+				::dup2(fds[1], 1);
+				::close(fds[0]);
+				::close(fds[1]);
+				int devnull = ::open("/dev/null", O_RDONLY);
+				if (devnull >= 0) {
+					::dup2(devnull, 0);
+					::close(devnull);
+				}
+				::execlp(bin.c_str(), bin.c_str(),
+					"-s", m_Key.c_str(),
+					"-w", "1",
+					"-m", "1",
+					"-a", m_Dir.c_str(),
+					"-t", m_Dir.c_str(),
+					static_cast<char*>(0));
+				::_exit(127);
+			}
+
+			// parent
+			::close(fds[1]);
+			m_Pipe = fds[0];
+			m_Child = pid;
+			m_Pending.clear();
+			std::cerr << "INFO: Started persistent " << bin << " (pid " << pid << ")" << std::endl;
+			return true;
+		}
+
+
+		//
+		//  Jt9Server::stop()
+		//
+		inline void Jt9Server::stop() {
+			if (m_Child > 0) {
+				// ask it to quit, and release it from the lock
+				touch(quitFile());
+				::unlink(lockFile().c_str());
+
+				// give it a moment, then insist
+				int status;
+				for (int i = 0; i != 20; ++i) {
+					if (::waitpid(m_Child, &status, WNOHANG) != 0) {
+						m_Child = -1;
+						break;
+					}
+					::usleep(50000);
+				}
+				if (m_Child > 0) {
+					::kill(m_Child, SIGTERM);
+					::waitpid(m_Child, &status, 0);
+				}
+			}
+			m_Child = -1;
+			if (m_Pipe >= 0) {
+				::close(m_Pipe);
+				m_Pipe = -1;
+			}
+			m_Shm.detach();
+			if ( ! m_Dir.empty()) {
+				::unlink(lockFile().c_str());
+				::unlink(quitFile().c_str());
+			}
+		}
+
+
+		//
+		//  Jt9Server::readLine(...)
+		//
+		inline bool Jt9Server::readLine(std::string &line) {
+			while (true) {
+				std::string::size_type idx = m_Pending.find('\n');
+				if (idx != std::string::npos) {
+					line.assign(m_Pending, 0, idx);
+					m_Pending.erase(0, idx + 1);
+					return true;
+				}
+
+				char iobuffer[512];
+				ssize_t ct = ::read(m_Pipe, iobuffer, sizeof(iobuffer));
+				if (ct < 0 && errno == EINTR)
+					continue;
+				if (ct <= 0)
+					return false;
+				m_Pending.append(iobuffer, ct);
+			}
+		}
+
+
+		//
+		//  Jt9Server::decode(...)
+		//
+		inline bool Jt9Server::decode(
+				const std::string &mode,
+				short depth,
+				double start,
+				const int16_t *samples,
+				size_t count,
+				IDecodeSink &sink,
+				int low,
+				int high) {
+			my::locker lock(m_Mutex);
+
+			if ( ! launch())
+				return false;
+
+			// wait for jt9 to be idle (it recreates the lock file after each pass)
+			for (int i = 0; ! exists(lockFile()); ++i) {
+				if (i == 200) {
+					std::cerr << "ERR: jt9 did not become idle" << std::endl;
+					return false;
+				}
+				::usleep(10000);
+			}
+
+			// copy the samples
+			Jt9SharedData *data = m_Shm.data();
+			const size_t max = sizeof(data->d2) / sizeof(data->d2[0]);
+			if (count > max)
+				count = max;
+			::memcpy(data->d2, samples, count * sizeof(int16_t));
+
+			// fill in the parameters, as WSJT-X does for a normal decode
+			Jt9Params &p = data->params;
+			::memset(&p, 0, sizeof(p));
+			time_t when = static_cast<time_t>(start + 0.5);
+			struct tm utc;
+			::gmtime_r(&when, &utc);
+			p.nutc = (utc.tm_hour * 10000) + (utc.tm_min * 100) + utc.tm_sec;
+			p.ndiskdat = false;
+			p.newdat = true;
+			p.nfqso = 1500;
+			p.nftx = 1500;
+			p.nfa = (high > low) ? low : 200;
+			p.nfb = (high > low) ? high : 4000;
+			p.nfSplit = 2700;
+			p.ntol = 20;
+			p.kin = static_cast<int32_t>(count);
+			p.ndepth = depth;
+			p.emedelay = 0;
+			p.dttol = 3.0;
+			p.n2pass = 2;
+			if (my::toLower(mode) == "ft4") {
+				p.nmode = 5;
+				p.ntrperiod = 7;
+				p.nzhsym = 21;
+			} else {
+				p.nmode = 8;
+				p.ntrperiod = 15;
+				p.nzhsym = 50;
+			}
+			::strftime(p.datetime, sizeof(p.datetime), "%y%m%d_%H%M%S", &utc);
+			::memset(p.mycall, ' ', sizeof(p.mycall));
+			::memset(p.mygrid, ' ', sizeof(p.mygrid));
+			::memset(p.hiscall, ' ', sizeof(p.hiscall));
+			::memset(p.hisgrid, ' ', sizeof(p.hisgrid));
+
+			// release jt9, and collect its output until the end marker
+			::unlink(lockFile().c_str());
+			std::string line;
+			while (readLine(line)) {
+				line = my::strip(line);
+				if (line.compare(0, strlen(KK5JY_JT9_FINISHED), KK5JY_JT9_FINISHED) == 0)
+					return true;
+				if (line.size() > 1 && isdigit(line[0]) && isdigit(line[1]))
+					sink.decoded(start, line);
+			}
+
+			// EOF before the end marker; jt9 died
+			std::cerr << "ERR: jt9 exited during decode" << std::endl;
+			stop();
+			return false;
+		}
+	}
+}
+
+#endif // __KK5JY_FT8_JT9SHM_H
@@ -17,6 +17,10 @@
 #ifndef __KK5JY_LOCKER_H
 #define __KK5JY_LOCKER_H
 
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
 namespace my {
 	//
 	//   class mutex - Encapsulates a mutex for thread synchronization.
@@ -85,6 +89,56 @@ namespace my {
 	}
 
 
+	//
+	//   class condition - Encapsulates a condition variable; always used
+	//                     together with a locked my::mutex.
+	//
+	class condition {
+		private:
+			pthread_cond_t m_cond;
+
+		private: // disallowed
+			condition(const condition&);
+			condition &operator=(const condition&);
+
+		public:
+			condition (void) { pthread_cond_init (&m_cond, 0); }
+			~condition (void) { pthread_cond_destroy (&m_cond); }
+
+			// wait for a signal; 'm' must be locked by the caller
+			bool wait (my::mutex &m);
+
+			// wait for a signal, or up to 'seconds'; returns false on timeout
+			bool wait (my::mutex &m, double seconds);
+
+			// wake one waiter, or all of them
+			void signal    (void) { pthread_cond_signal (&m_cond); }
+			void broadcast (void) { pthread_cond_broadcast (&m_cond); }
+	};
+
+
+	inline bool my::condition::wait (my::mutex &m) {
+		if (pthread_cond_wait (&m_cond, &m.m_mutex))
+			return false;
+		return true;
+	}
+
+	inline bool my::condition::wait (my::mutex &m, double seconds) {
+		struct timespec until;
+		clock_gettime (CLOCK_REALTIME, &until);
+		long whole = static_cast<long>(seconds);
+		until.tv_sec += whole;
+		until.tv_nsec += static_cast<long>((seconds - whole) * 1e9);
+		if (until.tv_nsec >= 1000000000L) {
+			until.tv_sec += 1;
+			until.tv_nsec -= 1000000000L;
+		}
+		if (pthread_cond_timedwait (&m_cond, &m.m_mutex, &until))
+			return false;
+		return true;
+	}
+
+
 	//
 	//  class locker - scope-based locking class
 	//
@@ -9,18 +9,31 @@
  *    License: GNU GPL3 (www.gnu.org)
  *
  *
+ *    The whole message is rendered when it is queued, as WSJT-X does it:
+ *    each symbol's frequency step is smoothed by a Gaussian pulse (GFSK),
+ *    from a table built once per modulator, and the ends of the message
+ *    are ramped in and out.  Reading the audio out is then just a copy
+ *    with the volume applied, which is cheap enough for the sound card
+ *    callback.
+ *
+ *    The Mixer sends several rendered messages at once, on different
+ *    tones, as a fox does.  It finds the true peak of their sum before
+ *    sending, and scales the sum so that the peak just reaches the
+ *    volume setting; a sum of N tones rarely peaks at N times one tone,
+ *    so each signal keeps more power than a fixed 1/N scaling gives it.
+ *
  */
 
 
 #ifndef __KK5JY_DSP_MFSK_H
 #define __KK5JY_DSP_MFSK_H
 
-#include "shape.h"
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
 #include "osc.h"
-#include "es.h"
-
-// number of cycles to shape on each end
-#define KK5JY_MFSK_SHAPER_CYCLES (10)
 
 
 namespace KK5JY {
@@ -39,31 +52,32 @@ namespace KK5JY {
 					double m_f0;    // the lowest tone in the group
 					double m_bps;   // transmitted symbol rate (per second)
 					double m_shift; // frequency shift between adjacent tones
+					bool m_Edges;   // send ramped copies of the end symbols (FT4)
 					std::string m_msg; // the message symbols
-					size_t m_idx;   // current symbol index
-					size_t m_ctr;   // number of samples emitted for current symbol
+					std::vector<double> m_Pulse; // GFSK frequency pulse, three symbols long
+					std::vector<T> m_Wave; // the rendered message, at unit amplitude
+					size_t m_pos;   // next sample of m_Wave to send
 					size_t m_lead;  // how much silence to emit up front
 					size_t m_leadctr; // lead-in counter
 					T m_Volume;     // output volume
 
-					// the oscillator
-					Osc<T> m_osc;
-
-					// the shift-shaper; smooths transition between symbols
-					Smoother<T> m_lpf;
-
-					// the envelope shaper; used to generate ramp-in and -out
-					Shaper<T> m_A;
+				private:
+					// render m_msg into m_Wave
+					void render();
 
 				public:
 					Modulator(
 						double fs,     // sampling frequency
 						double f0,     // lowest tone frequency
 						double bps,    // symbols per second
-						double shift); // shift between adjacent tones);
-				
+						double shift,  // shift between adjacent tones
+						double bt = 2.0,      // GFSK bandwidth-time product
+						bool edges = false);  // ramp whole symbols in and out
+
 				public:
-					// send a message; optionally change the lowest tone frequency
+					// send a message; optionally change the lowest tone
+					//    frequency; renders the audio, so call this from
+					//    outside the sound card callback
 					void transmit(const std::string &message, double f0 = 0);
 
 					// reset the modulator state
@@ -72,6 +86,12 @@ namespace KK5JY {
 					// reads out the encode wave data
 					size_t read(T* buffer, size_t count);
 
+					// the rendered message, at unit amplitude, without lead-in
+					const T *wave() const { return m_Wave.empty() ? 0 : &m_Wave[0]; }
+
+					// the number of samples in wave()
+					size_t length() const { return m_Wave.size(); }
+
 					// set the lead-in silence (samples)
 					size_t setLead(size_t newVal) { return (m_lead = newVal); }
 
@@ -91,16 +111,83 @@ namespace KK5JY {
 			//
 			template <typename T>
 			inline Modulator<T>::Modulator(
-				double fs, double f0, double bps, double shift) :
+				double fs, double f0, double bps, double shift, double bt, bool edges) :
 					bit_ratio(round(
 						static_cast<double>(fs) /
 						static_cast<double>(bps))),
-					m_fs(fs), m_f0(f0), m_bps(bps), m_shift(shift),
-					m_osc(f0, fs), m_lpf(LowpassToAlpha(fs, bps), f0),
-					m_A(KK5JY_MFSK_SHAPER_CYCLES * fs / f0) {
+					m_fs(fs), m_f0(f0), m_bps(bps), m_shift(shift), m_Edges(edges) {
 				m_lead = m_fs / 8; // 0.125 s
 				m_Volume = 0.9; // 90%
 				clear();
+
+				// the frequency pulse of one symbol: a rectangle one symbol
+				//    wide, smoothed by a Gaussian filter (gfsk_pulse.f90)
+				const double c = M_PI * std::sqrt(2.0 / std::log(2.0));
+				m_Pulse.resize(3 * bit_ratio);
+				for (size_t i = 0; i != m_Pulse.size(); ++i) {
+					double t = (static_cast<double>(i + 1) - (1.5 * bit_ratio)) / bit_ratio;
+					m_Pulse[i] = 0.5 * (::erf(c * bt * (t + 0.5)) - ::erf(c * bt * (t - 0.5)));
+				}
+			}
+
+
+			//
+			//  Modulator<T>::render() - the message as GFSK audio; follows
+			//     gen_ft8wave.f90 and gen_ft4wave.f90 from WSJT-X
+			//
+			template <typename T>
+			inline void Modulator<T>::render() {
+				const size_t nsps = bit_ratio;
+				const size_t nsym = m_msg.size();
+				m_Wave.clear();
+				if (nsym == 0)
+					return;
+
+				// the tone of symbol 'j' is tones[j + 1]; symbols -1 and nsym
+				//    repeat the first and last, so the ends settle on them
+				std::vector<int> tones(nsym + 2);
+				for (size_t j = 0; j != tones.size(); ++j) {
+					size_t idx = (j == 0) ? 0 : std::min(j - 1, nsym - 1);
+					tones[j] = m_msg[idx] - '0';
+				}
+
+				// phase steps: the carrier, plus the pulses of the (up to
+				//    three) symbols that overlap each sample
+				const double dphi_peak = 2.0 * M_PI * (m_shift / m_fs);
+				const double dphi_carrier = 2.0 * M_PI * (m_f0 / m_fs);
+				const size_t total = (nsym + 2) * nsps;
+				const size_t first = m_Edges ? 0 : nsps;
+				const size_t last = m_Edges ? total : (nsym + 1) * nsps;
+				m_Wave.resize(last - first);
+
+				// the phase steps go to a table oscillator as accumulator
+				//    steps, which also wraps the phase for free
+				const double toStep = 4294967296.0 / (2.0 * M_PI);
+				Nco<T> osc(0.0);
+				for (size_t k = 0; k != last; ++k) {
+					// symbol 'j' spans samples j * nsps to (j + 3) * nsps
+					const long s = k / nsps;
+					double dphi = dphi_carrier;
+					for (long j = s - 2; j <= s; ++j) {
+						if (j < -1 || j > static_cast<long>(nsym))
+							continue;
+						dphi += dphi_peak * tones[j + 1] * m_Pulse[k - (j * static_cast<long>(nsps))];
+					}
+					const uint32_t step = static_cast<uint32_t>(::llrint(dphi * toStep));
+					if (k >= first)
+						m_Wave[k - first] = osc.read(step);
+					else
+						osc.read(step);
+				}
+
+				// ramp the ends: a whole symbol with edge symbols (FT4),
+				//    otherwise an eighth of one
+				const size_t nramp = m_Edges ? nsps : (nsps / 8);
+				for (size_t i = 0; i != nramp && i < m_Wave.size(); ++i) {
+					const T a = static_cast<T>((1.0 - std::cos(M_PI * i / nramp)) / 2.0);
+					m_Wave[i] *= a;
+					m_Wave[m_Wave.size() - 1 - i] *= a;
+				}
 			}
 
 
@@ -121,19 +208,21 @@ namespace KK5JY {
 						clean += ch;
 				}
 				m_msg = clean;
-				if (m_ctr == 0)
+				render();
+				if (m_pos == 0)
 					m_leadctr = 0;
 			}
 
 
 			//
-			//  Modulator<T>::clear()
+			//  Modulator<T>::clear() - doesn't free the buffer, so it is safe
+			//     to call from the sound card callback
 			//
 			template <typename T>
 			inline void Modulator<T>::clear() {
-				m_msg = "";
-				m_idx = 0;
-				m_ctr = 0;
+				m_msg.clear();
+				m_Wave.clear();
+				m_pos = 0;
 				m_leadctr = 0;
 			}
 
@@ -143,7 +232,7 @@ namespace KK5JY {
 			//
 			template <typename T>
 			inline size_t Modulator<T>::read(T* buffer, size_t count) {
-				if (m_msg.size() == 0)
+				if (m_Wave.empty())
 					return 0;
 
 				// lead-in silence generation
@@ -154,49 +243,182 @@ namespace KK5JY {
 					++samples;
 				}
 
-				// if the lead-in silence consumed the whole buffer, quit
-				if (samples == count)
-					return count;
+				// copy out the rendered message, at the current volume
+				const size_t n = std::min(count - samples, m_Wave.size() - m_pos);
+				const T *src = &m_Wave[m_pos];
+				const T vol = m_Volume;
+				for (size_t i = 0; i != n; ++i)
+					buffer[i] = src[i] * vol;
+				m_pos += n;
+				samples += n;
+
+				// if everything sent, stop now
+				if (m_pos == m_Wave.size())
+					clear();
+
+				// return the number of samples written to 'buffer'
+				return samples;
+			}
+
+
+			//
+			//  class Mixer<T> - sums several rendered messages
+			//
+			template <typename T>
+			class Mixer {
+				private:
+					struct Stream {
+						Modulator<T> *mod;
+						T amplitude;
+					};
+
+					std::vector<Stream> m_Streams; // owned
+					size_t m_pos;     // next sample of the streams to send
+					size_t m_length;  // samples in the longest stream
+					size_t m_lead;    // how much silence to emit up front
+					size_t m_leadctr; // lead-in counter
+					T m_Gain;         // brings the peak of the sum to 1.0
+					T m_Volume;       // output volume
+
+				private:
+					// no copies; the streams are owned
+					Mixer(const Mixer&);
+					Mixer &operator=(const Mixer&);
+
+				public:
+					Mixer();
+					~Mixer();
+
+				public:
+					// add a rendered message, with its amplitude relative
+					//    to the others; takes ownership of 'mod'
+					void add(Modulator<T> *mod, T amplitude = 1);
+
+					// scale the sum so its peak is 1.0 (before the volume
+					//    is applied); call after the last add(), outside the
+					//    sound card callback; returns the peak of the sum
+					//    with unit amplitudes
+					T normalize();
+
+					// reads out the sum of the streams
+					size_t read(T *buffer, size_t count);
+
+					// the number of streams
+					size_t size() const { return m_Streams.size(); }
+
+					// the scale applied to the sum
+					T getGain(void) const { return m_Gain; }
+
+					// set the lead-in silence (samples)
+					size_t setLead(size_t newVal) { return (m_lead = newVal); }
 
-				// fetch the current symbol
-				char ch = m_msg[m_idx];
+					// get the lead-in silence (samples)
+					size_t getLead(void) const { return m_lead; }
 
-				// calculate current output frequency
-				double f = m_f0 + (m_shift * (ch - '0'));
+					// set the volume (normalized)
+					T setVolume(T newVal) { return (m_Volume = newVal); }
 
-				// main modulator loop
-				do {
-					// compute the unfiltered envelope value
-					bool lead_out =
-						(m_idx == (m_msg.size() - 1)) &&
-						(m_ctr >= static_cast<size_t>(bit_ratio - m_A.size()));
-					double A_in = lead_out ? 0 : 1;
+					// get the volume (normalized)
+					T getVolume(void) const { return m_Volume; }
+			};
 
-					// generate the waveform; add lead-in/out where needed
-					m_osc.setFreq(m_lpf.run(f), m_fs);
-					*buffer++ = m_osc.read() * m_Volume * m_A.run(A_in);
-					//             ^ LO ^    *  ^vol^   *   ^env^
 
-					// if time for the next symbol...
-					if (++m_ctr == bit_ratio) {
-						m_ctr = 0;
+			//
+			//  Mixer<T>::Mixer
+			//
+			template <typename T>
+			inline Mixer<T>::Mixer()
+				: m_pos(0), m_length(0), m_lead(0), m_leadctr(0), m_Gain(1), m_Volume(0.9) {
+				// nop
+			}
+
 
-						// if everything sent, stop now
-						if (++m_idx == m_msg.size()) {
-							clear();
-							break;
-						}
+			//
+			//  Mixer<T>::~Mixer
+			//
+			template <typename T>
+			inline Mixer<T>::~Mixer() {
+				for (size_t i = 0; i != m_Streams.size(); ++i)
+					delete m_Streams[i].mod;
+			}
+
+
+			//
+			//  Mixer<T>::add(...)
+			//
+			template <typename T>
+			inline void Mixer<T>::add(Modulator<T> *mod, T amplitude) {
+				Stream s;
+				s.mod = mod;
+				s.amplitude = amplitude;
+				m_Streams.push_back(s);
+				m_length = std::max(m_length, mod->length());
+			}
 
-						// fetch next character
-						ch = m_msg[m_idx];
 
-						// compute the new frequency
-						f = m_f0 + (m_shift * (ch - '0'));
+			//
+			//  Mixer<T>::normalize() - sums the streams a block at a time, to
+			//     find the peak that read() will produce
+			//
+			template <typename T>
+			inline T Mixer<T>::normalize() {
+				const size_t block = 4096;
+				std::vector<T> sum(block);
+				T peak = 0;
+				for (size_t pos = 0; pos < m_length; pos += block) {
+					const size_t n = std::min(block, m_length - pos);
+					std::fill(sum.begin(), sum.begin() + n, static_cast<T>(0));
+					for (size_t s = 0; s != m_Streams.size(); ++s) {
+						const Modulator<T> *mod = m_Streams[s].mod;
+						if (pos >= mod->length())
+							continue;
+						const size_t ct = std::min(n, mod->length() - pos);
+						const T *src = mod->wave() + pos;
+						const T a = m_Streams[s].amplitude;
+						for (size_t i = 0; i != ct; ++i)
+							sum[i] += src[i] * a;
 					}
-				} while (++samples != count);
+					for (size_t i = 0; i != n; ++i)
+						peak = std::max(peak, static_cast<T>(std::fabs(sum[i])));
+				}
+				m_Gain = (peak > 0) ? (1 / peak) : 1;
+				return peak;
+			}
+
+
+			//
+			//  Mixer<T>::read(...)
+			//
+			template <typename T>
+			inline size_t Mixer<T>::read(T *buffer, size_t count) {
+				if (m_pos >= m_length)
+					return 0;
+
+				// lead-in silence generation
+				size_t samples = 0;
+				while (m_leadctr < m_lead && samples < count) {
+					*buffer++ = 0;
+					++m_leadctr;
+					++samples;
+				}
+
+				// sum the streams right into the output
+				const size_t n = std::min(count - samples, m_length - m_pos);
+				std::fill(buffer, buffer + n, static_cast<T>(0));
+				for (size_t s = 0; s != m_Streams.size(); ++s) {
+					const Modulator<T> *mod = m_Streams[s].mod;
+					if (m_pos >= mod->length())
+						continue;
+					const size_t ct = std::min(n, mod->length() - m_pos);
+					const T *src = mod->wave() + m_pos;
+					const T a = m_Streams[s].amplitude * m_Gain * m_Volume;
+					for (size_t i = 0; i != ct; ++i)
+						buffer[i] += src[i] * a;
+				}
+				m_pos += n;
 
 				// return the number of samples written to 'buffer'
-				return samples;
+				return samples + n;
 			}
 		}
 	}
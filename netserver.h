@@ -0,0 +1,414 @@
+/*
+ *
+ *
+ *    netserver.h
+ *
+ *    Non-blocking TCP server for many clients.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    One thread runs an edge-triggered epoll loop over the listening
+ *    socket and every connection.  Each connection has its own output
+ *    buffer, so a reply to a slow client waits there instead of holding
+ *    up the loop; a client that lets KK5JY_NET_MAX_OUTPUT bytes pile up
+ *    is disconnected.  A client that shuts down its sending side is
+ *    kept until everything for it has been sent.
+ *
+ *    Other threads can't touch the clients, but can wake() the loop,
+ *    which then calls the handler's woken() from the loop's thread.
+ *
+ */
+
+#ifndef __KK5JY_NETSERVER_H
+#define __KK5JY_NETSERVER_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+
+// the most output a client may have waiting (bytes)
+#ifndef KK5JY_NET_MAX_OUTPUT
+#define KK5JY_NET_MAX_OUTPUT (256 * 1024)
+#endif
+
+namespace KK5JY {
+	namespace Net {
+		class NetServer;
+
+		//
+		//  class NetClient - one connection
+		//
+		class NetClient {
+			private:
+				int m_Socket;
+				std::string m_Output;   // not yet accepted by the socket
+				std::string m_Address;
+				bool m_Closing;
+				bool m_ReadDone;        // the peer sends no more
+
+				friend class NetServer;
+
+			private: // disallowed
+				NetClient(const NetClient&);
+				NetClient &operator=(const NetClient&);
+
+			private:
+				// send what the socket will take now
+				void flush();
+
+			public:
+				NetClient(int fd, const std::string &address)
+					: m_Socket(fd), m_Address(address), m_Closing(false), m_ReadDone(false) { /* nop */ }
+				~NetClient() { ::close(m_Socket); }
+
+			public:
+				// the command line being received
+				std::string line;
+
+			public:
+				// queue data for the client; never blocks
+				void send(const std::string &data);
+				void send(const char *data) { send(std::string(data)); }
+
+				// close the connection once the event loop gets to it
+				void close() { m_Closing = true; }
+
+				// the socket; used as the client ID in logs
+				int id() const { return m_Socket; }
+
+				// the peer address
+				const std::string &address() const { return m_Address; }
+
+				// the number of bytes waiting to be sent
+				size_t pending() const { return m_Output.size(); }
+		};
+
+
+		//
+		//  class INetHandler - the server's user
+		//
+		class INetHandler {
+			public:
+				// a client connected
+				virtual void connected(NetClient &client) { /* nop */ };
+
+				// data arrived from 'client'
+				virtual void received(NetClient &client, const char *data, size_t count) = 0;
+
+				// 'client' is about to be closed and deleted
+				virtual void disconnected(NetClient &client) { /* nop */ };
+
+				// the socket of 'client' took more of its output
+				virtual void writable(NetClient &client) { /* nop */ };
+
+				// true while output for 'client' is still held back, so a
+				//    client that has stopped sending isn't closed yet
+				virtual bool holding(NetClient &client) { return false; };
+
+				// another thread called wake()
+				virtual void woken() { /* nop */ };
+
+				// virtual dtor
+				virtual ~INetHandler() { /* nop */ };
+		};
+
+
+		//
+		//  class NetServer
+		//
+		class NetServer {
+			private:
+				int m_Listen;
+				int m_Poll;
+				int m_Wake;
+				INetHandler *m_Handler;
+				std::map<int, NetClient*> m_Clients;
+
+			private: // disallowed
+				NetServer(const NetServer&);
+				NetServer &operator=(const NetServer&);
+
+			private:
+				// accept all waiting connections
+				void accept();
+
+				// read everything waiting from 'client'
+				void read(NetClient *client);
+
+				// close and delete 'client'
+				void drop(NetClient *client);
+
+			public:
+				NetServer(unsigned short port, INetHandler *handler, int backlog = 16);
+				~NetServer();
+
+			public:
+				// wait up to 'timeout' ms (-1 = forever) for network
+				//    events, and handle them
+				void poll(int timeout = -1);
+
+				// make poll() call the handler's woken(); safe from any thread
+				void wake();
+
+				// the number of clients connected
+				size_t clients() const { return m_Clients.size(); }
+
+				// the client with the given id(), or null
+				NetClient *client(int id) const {
+					std::map<int, NetClient*>::const_iterator it = m_Clients.find(id);
+					return (it == m_Clients.end()) ? 0 : it->second;
+				}
+		};
+
+
+		//
+		//  NetClient::send(...)
+		//
+		inline void NetClient::send(const std::string &data) {
+			if (m_Closing)
+				return;
+			m_Output.append(data);
+			flush();
+			if (m_Output.size() > KK5JY_NET_MAX_OUTPUT) {
+				std::cerr << "WARN: Client " << m_Socket << " isn't reading its replies; disconnecting" << std::endl;
+				m_Output.clear();
+				m_Closing = true;
+			}
+		}
+
+
+		//
+		//  NetClient::flush()
+		//
+		inline void NetClient::flush() {
+			size_t sent = 0;
+			while (sent < m_Output.size()) {
+				ssize_t ct = ::send(m_Socket, m_Output.data() + sent, m_Output.size() - sent, MSG_NOSIGNAL);
+				if (ct > 0) {
+					sent += ct;
+					continue;
+				}
+				if (ct < 0 && errno == EINTR)
+					continue;
+				if (ct < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					break; // EPOLLOUT resumes it
+				m_Closing = true;
+				break;
+			}
+			m_Output.erase(0, sent);
+		}
+
+
+		//
+		//  NetServer::NetServer
+		//
+		inline NetServer::NetServer(unsigned short port, INetHandler *handler, int backlog)
+			: m_Listen(-1), m_Poll(-1), m_Wake(-1), m_Handler(handler) {
+			if ((m_Listen = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+				throw std::runtime_error("socket failed");
+
+			int opt = 1;
+			::setsockopt(m_Listen, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt));
+
+			struct sockaddr_in address;
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = INADDR_ANY;
+			address.sin_port = htons(port);
+			if (::bind(m_Listen, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+				::close(m_Listen);
+				throw std::runtime_error("bind failed");
+			}
+			if (::listen(m_Listen, backlog) < 0) {
+				::close(m_Listen);
+				throw std::runtime_error("listen failed");
+			}
+
+			if ((m_Poll = ::epoll_create1(0)) < 0) {
+				::close(m_Listen);
+				throw std::runtime_error("epoll_create1 failed");
+			}
+			struct epoll_event ev;
+			ev.events = EPOLLIN | EPOLLET;
+			ev.data.fd = m_Listen;
+			::epoll_ctl(m_Poll, EPOLL_CTL_ADD, m_Listen, &ev);
+
+			if ((m_Wake = ::eventfd(0, EFD_NONBLOCK)) < 0) {
+				::close(m_Poll);
+				::close(m_Listen);
+				throw std::runtime_error("eventfd failed");
+			}
+			ev.events = EPOLLIN | EPOLLET;
+			ev.data.fd = m_Wake;
+			::epoll_ctl(m_Poll, EPOLL_CTL_ADD, m_Wake, &ev);
+		}
+
+
+		//
+		//  NetServer::~NetServer
+		//
+		inline NetServer::~NetServer() {
+			while ( ! m_Clients.empty())
+				drop(m_Clients.begin()->second);
+			::close(m_Wake);
+			::close(m_Poll);
+			::shutdown(m_Listen, SHUT_RDWR);
+			::close(m_Listen);
+		}
+
+
+		//
+		//  NetServer::poll(...)
+		//
+		inline void NetServer::poll(int timeout) {
+			struct epoll_event events[32];
+			int ct = ::epoll_wait(m_Poll, events, 32, timeout);
+			for (int i = 0; i < ct; ++i) {
+				if (events[i].data.fd == m_Listen) {
+					accept();
+					continue;
+				}
+				if (events[i].data.fd == m_Wake) {
+					uint64_t count;
+					while (::read(m_Wake, &count, sizeof(count)) > 0)
+						{ /* nop */ }
+					if (m_Handler)
+						m_Handler->woken();
+					continue;
+				}
+
+				std::map<int, NetClient*>::iterator it = m_Clients.find(events[i].data.fd);
+				if (it == m_Clients.end())
+					continue;
+				NetClient *client = it->second;
+				if (events[i].events & EPOLLOUT) {
+					client->flush();
+					if (m_Handler && ! client->m_Closing)
+						m_Handler->writable(*client);
+				}
+				if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+					read(client);
+				if (events[i].events & (EPOLLHUP | EPOLLERR))
+					client->m_Closing = true; // nothing more can be sent
+			}
+
+			// close the clients that are done; one that has only stopped
+			//    sending is kept until its replies are all sent
+			std::vector<NetClient*> done;
+			for (std::map<int, NetClient*>::iterator it = m_Clients.begin(); it != m_Clients.end(); ++it) {
+				NetClient *client = it->second;
+				if (client->m_Closing)
+					done.push_back(client);
+				else if (client->m_ReadDone && client->m_Output.empty() && ! (m_Handler && m_Handler->holding(*client)))
+					done.push_back(client);
+			}
+			for (size_t i = 0; i != done.size(); ++i)
+				drop(done[i]);
+		}
+
+
+		//
+		//  NetServer::wake()
+		//
+		inline void NetServer::wake() {
+			uint64_t one = 1;
+			if (::write(m_Wake, &one, sizeof(one)) < 0)
+				{ /* nop; already signalled */ }
+		}
+
+
+		//
+		//  NetServer::accept()
+		//
+		inline void NetServer::accept() {
+			while (true) {
+				struct sockaddr_in address;
+				socklen_t addrlen = sizeof(address);
+				int fd = ::accept4(m_Listen, reinterpret_cast<struct sockaddr*>(&address), &addrlen, SOCK_NONBLOCK);
+				if (fd < 0) {
+					if (errno == EINTR)
+						continue;
+					if (errno != EAGAIN && errno != EWOULDBLOCK)
+						perror("accept");
+					return;
+				}
+
+				// replies are small; don't hold them back
+				int opt = 1;
+				::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+				char name[INET_ADDRSTRLEN] = "";
+				::inet_ntop(AF_INET, &address.sin_addr, name, sizeof(name));
+				NetClient *client = new NetClient(fd, name);
+				m_Clients[fd] = client;
+
+				struct epoll_event ev;
+				ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+				ev.data.fd = fd;
+				::epoll_ctl(m_Poll, EPOLL_CTL_ADD, fd, &ev);
+
+				if (m_Handler)
+					m_Handler->connected(*client);
+			}
+		}
+
+
+		//
+		//  NetServer::read(...) - edge-triggered, so read until the
+		//     socket is empty
+		//
+		inline void NetServer::read(NetClient *client) {
+			char iobuffer[4096];
+			while ( ! client->m_Closing && ! client->m_ReadDone) {
+				ssize_t ct = ::recv(client->m_Socket, iobuffer, sizeof(iobuffer), 0);
+				if (ct > 0) {
+					if (m_Handler)
+						m_Handler->received(*client, iobuffer, ct);
+					continue;
+				}
+				if (ct < 0 && errno == EINTR)
+					continue;
+				if (ct < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					return;
+
+				// EOF; the peer may still be reading what it asked for
+				if (ct == 0) {
+					client->m_ReadDone = true;
+					return;
+				}
+
+				// error
+				client->m_Closing = true;
+			}
+		}
+
+
+		//
+		//  NetServer::drop(...)
+		//
+		inline void NetServer::drop(NetClient *client) {
+			if (m_Handler)
+				m_Handler->disconnected(*client);
+			::epoll_ctl(m_Poll, EPOLL_CTL_DEL, client->m_Socket, 0);
+			m_Clients.erase(client->m_Socket);
+			delete client;
+		}
+	}
+}
+
+#endif // __KK5JY_NETSERVER_H
+
+// EOF
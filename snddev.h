@@ -59,6 +59,40 @@ using std::sprintf;
 // mutex locking
 #include "locker.h"
 
+// lock-free callback queue
+#include "spsc.h"
+
+// receive audio history
+#include "capture.h"
+
+// capture worker thread
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
+
+// number of samples carried by each capture chunk
+#define KK5JY_CAPTURE_CHUNK (256)
+
+// number of chunks in the capture queue (power of two)
+#define KK5JY_CAPTURE_QUEUE (1024)
+
+// default number of decode worker threads
+#define KK5JY_DECODE_WORKERS (2)
+
+// number of slots that may wait for a decode worker
+#define KK5JY_DECODE_QUEUE (4)
+
+// number of entries in the sound callback -> worker TX event queue
+//    (power of two); a slot produces at most three
+#define KK5JY_TX_EVENTS (64)
+
+// time into the slot at which transmission starts on the air (seconds);
+//    a signal starting here has a DT of zero
+#define KK5JY_TX_START (0.5)
+
+// time into an FT8 slot of the early decode pass (seconds)
+#define KK5JY_EARLY_FT8 (11.8)
+
 
 //
 //  enum TimeSlots
@@ -66,7 +100,8 @@ using std::sprintf;
 enum TimeSlots {
 	NextSlot = 0,
 	OddSlot = 1,
-	EvenSlot = 2
+	EvenSlot = 2,
+	AbsoluteSlot = 3 // one slot, by number (UTC seconds / slot length)
 };
 
 
@@ -78,19 +113,27 @@ class DecodedLine {
 	private:
 		long int _time;
 		string _content;
+		bool _early; // from the early pass; the full decode replaces it
+		uint64_t _sequence; // order the modem accepted it in; 0 = not yet
 	
 	public:
-		DecodedLine(long int = 0, string = "");
+		DecodedLine(long int = 0, string = "", bool = false);
 		~DecodedLine();
 		void setTime(long int);
 		long int getTime() const;
 		string getContent() const;
+		string getMessage() const;
+		bool isEarly() const;
+		void setSequence(uint64_t);
+		uint64_t getSequence() const;
 };
 
 
-inline DecodedLine::DecodedLine(long int time, string content):
+inline DecodedLine::DecodedLine(long int time, string content, bool early):
 	_time(time),
-	_content(content)
+	_content(content),
+	_early(early),
+	_sequence(0)
 {
 
 }
@@ -115,72 +158,314 @@ inline string DecodedLine::getContent() const
 	return (_content);
 }
 
+//
+// The message text alone, without SNR, DT and frequency (which
+// differ between decoding passes)
+//
+inline string DecodedLine::getMessage() const
+{
+	string::size_type idx = _content.find_first_of("~+");
+	if (idx == string::npos)
+		return (_content);
+	return (my::strip(_content.substr(idx + 1)));
+}
+
+inline bool DecodedLine::isEarly() const
+{
+	return (_early);
+}
+
+inline void DecodedLine::setSequence(uint64_t sequence)
+{
+	_sequence = sequence;
+}
+
+inline uint64_t DecodedLine::getSequence() const
+{
+	return (_sequence);
+}
+
+
+// the capture worker thread
+class ModemSoundDevice;
+void *capture_thread(void *parent);
+
+
+//
+//  struct TxStream - one of the messages sent together in a slot
+//
+struct TxStream {
+	std::string message; // the text, as provided
+	double f0;           // lowest tone frequency
+	float amplitude;     // relative to the other streams
+
+	TxStream(const std::string &msg = "", double f = 0, float a = 1)
+		: message(msg), f0(f), amplitude(a) { /* nop */ }
+};
+
+
+//
+//  struct TxStatus - a queued transmission, as listed by txQueue()
+//
+struct TxStatus {
+	enum States {
+		Queued,  // waiting behind another message
+		Ready,   // next up; the sound callback sends it in its slot
+		Sending  // on the air
+	};
+
+	unsigned id;         // assigned by transmit(); never 0
+	States state;
+	TimeSlots slot;      // target slot
+	long target;         // slot number, for AbsoluteSlot
+	vector<TxStream> streams; // the messages, sent at once
+};
+
+
+//
+//  struct TxJob - messages, encoded and rendered ahead of their slot
+//
+struct TxJob {
+	TxStatus info;
+	KK5JY::DSP::MFSK::Mixer<float> *mfsk;
+	std::atomic<bool> cancelled; // remove without sending it
+
+	TxJob() : mfsk(0), cancelled(false) { /* nop */ }
+	~TxJob() { if (mfsk) delete mfsk; }
+};
+
+
+//
+//  struct CaptureChunk - one message from the sound callback to the capture worker
+//
+struct CaptureChunk {
+	enum Kinds {
+		Samples,   // decimated receive audio
+		SlotStart, // start capturing a new slot
+		SlotEnd    // slot captured; start decoding it
+	};
+
+	Kinds kind;
+	double time;   // absolute time of the first sample, or of the slot boundary
+	size_t count;  // number of valid samples in 'data'
+	float data[KK5JY_CAPTURE_CHUNK];
+};
+
+
+//
+//  struct TxEvent - a change of TX state, from the sound callback to the
+//     capture worker; the callback never frees a job, so a job it is done
+//     with travels back this way to be deleted
+//
+struct TxEvent {
+	enum Kinds {
+		Start, // 'job' is on the air
+		Stop,  // 'job' finished; it must be deleted
+		Skip   // 'job' cancelled or its slot passed; it must be deleted
+	};
+
+	Kinds kind;
+	TxJob *job;
+};
+
 
 //
 //  ModemSoundDevice
 //
-class ModemSoundDevice : public SoundCard {
+class ModemSoundDevice : public SoundCard, public KK5JY::FT8::IDecodeSink {
 	private:
-		// the clock
-		KK5JY::FT8::FrameClock m_Clock;
+		// the clock, counted in samples (sound callback only)
+		KK5JY::FT8::SampleClock m_Clock;
 
-		// the decimator clock
-		KK5JY::DSP::FirFilter<float> *m_Filter;
+		// the decimation filter
+		KK5JY::DSP::FirDecimator<float> *m_Filter;
 
 		// decoders
-		KK5JY::FT8::Decode<float> *m_Current;
-		KK5JY::FT8::Decode<float> *m_Decoding;
-
-		// the modulator
-		KK5JY::DSP::MFSK::Modulator<float> *m_MFSK;
+		KK5JY::FT8::CaptureRing m_History; // the receive audio (capture worker writes)
+		double m_SlotStart;    // start of the open capture window (capture worker only)
+		bool m_SlotOpen;       // a capture window is open (capture worker only)
+		bool m_EarlyPending;   // the early pass of the open window is due (capture worker only)
+		size_t m_EarlySamples; // samples to capture before the early pass; 0 = none
+		volatile bool m_EarlyEnabled;
+		std::deque<KK5JY::FT8::Decode<float>*> m_Decoding; // queued or running; m_DecodedLock
+		KK5JY::FT8::DecodeScheduler *m_Scheduler;
+
+		// the transmit queue; the network thread renders each message when
+		//    it is queued, and the capture worker moves the head of the
+		//    queue to m_TxReady, where the sound callback picks it up
+		std::deque<TxJob*> m_TxQueue; // m_TxLock
+		std::atomic<TxJob*> m_TxReady; // set by promoteTx(); cleared by the callback
+		TxJob *m_TxJob;   // being sent (sound callback only)
+		TxJob *m_TxOnAir; // being sent, as seen by the worker; m_TxLock
+		unsigned m_TxNextId; // m_TxLock
+		my::mutex m_TxLock;
 
 		std::string m_TempDir; // path to temp folder
 		std::string m_Mode;  // mode string
 		size_t m_Rate;     // sampling ratevoid
 		size_t m_DecFact;  // decimation factor
-		size_t m_Lead;     // number of samples of silence to emit before transmission
+		size_t m_Lead;     // samples from the slot boundary to the start of transmission
+		std::atomic<double> m_OutLatency; // sound card output latency (seconds)
+		std::atomic<double> m_TxOffset;   // measured extra latency (seconds)
 		double m_FrameStart, m_FrameEnd, m_FrameSize, m_TxWinStart, m_TxWinEnd;
 		double m_bps, m_shift; // MFSK parameters
+		double m_bt;       // GFSK bandwidth-time product
+		bool m_EdgeSymbols; // ramp whole symbols in and out (FT4)
 		short m_Depth; // decoding depth (1...3)
 		float m_Volume; // output volume (normalized)
-		volatile bool m_FrameCounter;
+		unsigned m_FrameCounter; // makes the WAV file names unique; m_DecodedLock
 		volatile bool m_Sending;
 		volatile bool m_Active;
-		volatile bool m_Abort;
-
-		enum TimeSlots m_Slot;
-
-		// critical section mutex
-		my::mutex m_Mutex;
+		std::atomic<bool> m_Abort; // stop sending
+		std::atomic<unsigned> m_TxAirId;   // ID of the job on the air, or 0 (set by the callback)
+		std::atomic<unsigned> m_TxAbortId; // stop sending the job with this ID
+		volatile bool m_Capturing; // sound callback is inside a capture window
+		volatile bool m_Shutdown;  // tell the capture worker to exit
+
+		// decodes streamed from the decoder thread, waiting for run()
+		std::deque<DecodedLine> m_Decoded;
+		bool m_DecodeFinished; // a decoder thread has exited
+		my::mutex m_DecodedLock;
+		my::condition m_DecodedReady;
+
+		// sound callback -> capture worker queue
+		my::spsc_ring<CaptureChunk> m_Capture;
+		std::atomic<size_t> m_Overruns; // chunks dropped because the queue was full
+		my::spsc_ring<TxEvent> m_TxEvents;
+		std::atomic<size_t> m_TxOverruns; // TX events lost; their jobs leak
+		sem_t m_CaptureReady;
+		pthread_t m_CaptureThread;
+
+		// the capture worker
+		friend void *capture_thread(void *parent);
+		void captureWorker();
+
+		// hand the audio from 'start' to 'end' to the decode scheduler,
+		//    labelled as captured at 'label'
+		bool startDecode(double label, double start, double end, short depth, KK5JY::FT8::IDecodeSink *sink);
+
+		// move the head of the TX queue to m_TxReady, if that is free
+		void promoteTx();
+
+		// passes early pass lines on, marked as early
+		class EarlySink : public KK5JY::FT8::IDecodeSink {
+			private:
+				ModemSoundDevice *m_Device;
+			public:
+				EarlySink(ModemSoundDevice *dev) : m_Device(dev) { /* nop */ }
+				void decoded(double start, const std::string &line);
+				void finished(double start);
+		};
+		EarlySink m_EarlySink;
+
+		// queue one line for run()
+		void queueDecoded(double start, const std::string &line, bool early);
+
+		// queue a chunk for the capture worker (sound callback only)
+		void post(CaptureChunk::Kinds kind, const float *data = 0, size_t count = 0, double time = 0);
+
+		// the number of decimated samples in a buffer of 'ct', starting
+		//    'sec' into the slot, that come before 'boundary'
+		size_t samplesBefore(double boundary, double sec, size_t ct) const;
+
+		// queue a TX event for the capture worker (sound callback only)
+		void post(TxEvent::Kinds kind, TxJob *job);
 
 	public:
 		ModemSoundDevice(const std::string &mode, size_t id, size_t rate, size_t win = 512);
 		~ModemSoundDevice();
 
-		// TODO: this should probably be replace by a thread
-		vector<DecodedLine> * run();
+		// wait for new decodes, and return them; the wait ends early
+		//    when a decode finishes, and after 'timeout' seconds
+		vector<DecodedLine> * run(double timeout = 1.0);
+
+		// receive one line from the decoder thread (IDecodeSink)
+		void decoded(double start, const std::string &line);
 
-		// send a message
-		bool transmit(const std::string &message, double f0, TimeSlots slot = NextSlot);
+		// a decoder thread is done (IDecodeSink)
+		void finished(double start);
 
-		// stop sending immediately
+		// queue a message to send in 'slot' (or in slot number 'target',
+		//    for AbsoluteSlot), after those already queued; returns its
+		//    ID, or zero if the message can't be encoded
+		unsigned transmit(const std::string &message, double f0, TimeSlots slot = NextSlot, long target = 0);
+
+		// queue several messages to send at once, on their own tones;
+		//    returns zero if any of them can't be encoded
+		unsigned transmit(const vector<TxStream> &streams, TimeSlots slot = NextSlot, long target = 0);
+
+		// stop sending immediately, and empty the queue
 		void cancelTransmit();
 
+		// remove one message from the queue, or stop it if it is being
+		//    sent; returns false if there is no such message
+		bool cancelTransmit(unsigned id);
+
+		// list the messages being sent and waiting to be sent
+		vector<TxStatus> txQueue();
+
+		// decode slot number 'slot' again from the receive audio history,
+		//    at 'depth', with the audio window moved by 'shift' seconds;
+		//    returns false if the slot isn't held (or not yet complete)
+		bool redecode(long slot, short depth, double shift = 0);
+
+		// the number of the current slot (UTC seconds / slot length)
+		long currentSlot() const { return static_cast<long>(::floor(KK5JY::FT8::abstime() / m_FrameSize)); }
+
 		// test whether sound card is running
 		bool isActive() const volatile { return m_Active; }
 
 		// set the decoding depth
 		short setDepth(short depth);
 
+		// set the number of slots decoded at once
+		size_t setDecoders(size_t workers) { return m_Scheduler->setWorkers(workers); }
+
+		// get the number of slots decoded at once
+		size_t getDecoders(void) const { return m_Scheduler->getWorkers(); }
+
+		// set the number of frequency sub-bands each slot is split into
+		size_t setBands(size_t bands) { return m_Scheduler->setBands(bands); }
+
+		// get the number of frequency sub-bands
+		size_t getBands(void) const { return m_Scheduler->getBands(); }
+
+		// enable a quick depth 1 decode of each FT8 slot, ahead of the
+		//    full decode; its results are replaced by the full decode's
+		bool setEarly(bool enable) { return (m_EarlyEnabled = enable && m_EarlySamples); }
+
+		// get the early decode state
+		bool getEarly(void) const { return m_EarlyEnabled; }
+
+		// set what happens when decoding falls behind
+		KK5JY::FT8::DecodeScheduler::Policies setOverload(KK5JY::FT8::DecodeScheduler::Policies policy) {
+			return m_Scheduler->setPolicy(policy);
+		}
+
 		// get the decoding depth
 		short setDepth(void) const { return m_Depth; }
 
-		// set the lead-in silence (samples)
+		// start the sound card, and read its output latency
+		bool start();
+
+		// set when transmission starts, in samples after the slot
+		//    boundary, as heard on the air
 		size_t setLead(size_t newVal) { return (m_Lead = newVal); }
 
-		// get the lead-in silence (samples)
+		// get when transmission starts (samples)
 		size_t getLead(void) const { return m_Lead; }
 
+		// set the latency after the sound card (rig, USB, etc.) in
+		//    seconds, as measured by the user; negative if the sound
+		//    card's own figure is too high
+		double setTxOffset(double newVal) { m_TxOffset = newVal; return newVal; }
+
+		// get the latency after the sound card (seconds)
+		double getTxOffset(void) const { return m_TxOffset; }
+
+		// get the output latency reported by the sound card (seconds)
+		double getOutputLatency(void) const { return m_OutLatency; }
+
 		// set the volume (normalized)
 		float setVolume(float newVal) { return (m_Volume = newVal); }
 
@@ -197,16 +482,28 @@ class ModemSoundDevice : public SoundCard {
 //
 inline ModemSoundDevice::ModemSoundDevice(const std::string &mode, size_t id, size_t rate, size_t win) :
 		SoundCard(id, rate, 1, win),
-		m_Filter(0), m_Current(0), m_Decoding(0), m_MFSK(0) {
+		m_Clock(rate),
+		m_Filter(0), m_SlotStart(0), m_SlotOpen(false), m_EarlyPending(false), m_EarlySamples(0),
+		m_EarlyEnabled(false), m_Scheduler(0),
+		m_TxReady(0), m_TxJob(0), m_TxOnAir(0), m_TxNextId(1),
+		m_OutLatency(0), m_TxOffset(0),
+		m_DecodeFinished(false),
+		m_Capture(KK5JY_CAPTURE_QUEUE), m_Overruns(0),
+		m_TxEvents(KK5JY_TX_EVENTS), m_TxOverruns(0), m_EarlySink(this) {
 	m_Mode = mode;
 	m_TempDir = "/tmp/"; // TODO: make this configurable
 	m_Depth = 1;
 	m_Rate = rate;
-	m_FrameCounter = false;
+	m_FrameCounter = 0;
 	m_Sending = false;
-	m_Lead = 0.125 * m_Rate; // 125ms
+	m_Lead = KK5JY_TX_START * m_Rate; // where DT is zero
 	m_Volume = 0.5; // 50%
 	m_Abort = false;
+	m_TxAirId = 0;
+	m_TxAbortId = 0;
+	m_Active = false;
+	m_Capturing = false;
+	m_Shutdown = false;
 	// calculate the decimation factor
 	m_DecFact = rate / 12000;
 
@@ -218,12 +515,15 @@ inline ModemSoundDevice::ModemSoundDevice(const std::string &mode, size_t id, si
 		throw std::runtime_error("Window size must be multiple of decimation factor");
 	}
 
-	// allocate decimation filter
-	m_Filter = new KK5JY::DSP::FirFilter<float>(
-		KK5JY::DSP::FirFilterTypes::LowPass, // type
-		25,    // taps
-		5000,  // cutoff
-		rate); // rate
+	// allocate decimation filter; the length scales with the rate so the
+	//    transition band stays the same width (25 taps at 48kHz)
+	if (m_DecFact > 1) {
+		m_Filter = new KK5JY::DSP::FirDecimator<float>(
+			m_DecFact,         // factor
+			6 * m_DecFact + 1, // taps
+			5000,              // cutoff
+			rate);             // rate
+	}
 
 	// configure mode-specific timings
 	std::string realMode = my::strip(my::toUpper(mode));
@@ -235,6 +535,11 @@ inline ModemSoundDevice::ModemSoundDevice(const std::string &mode, size_t id, si
 		m_FrameEnd = 13.0;
 		m_bps = 6.25;
 		m_shift = m_bps;
+		m_bt = 2.0;
+		m_EdgeSymbols = false;
+
+		// capture starts (m_FrameSize - m_FrameStart) before the slot
+		m_EarlySamples = (KK5JY_EARLY_FT8 + m_FrameSize - m_FrameStart) * 12000;
 	} else if (realMode == "FT4") {
 		m_TxWinStart = 0.0;
 		m_TxWinEnd = 1.0;
@@ -243,19 +548,326 @@ inline ModemSoundDevice::ModemSoundDevice(const std::string &mode, size_t id, si
 		m_FrameEnd = 13.0 / 2;
 		m_bps = 12000.0 / 576.0;
 		m_shift = m_bps;
+		m_bt = 1.0;
+		m_EdgeSymbols = true;
+
+		// no early pass; like WSJT-X, only FT8 has one
+		m_EarlySamples = 0;
 	} else {
 		throw std::runtime_error("Unsupported mode provided");
 	}
+
+	// start the decode workers
+	m_Scheduler = new KK5JY::FT8::DecodeScheduler(KK5JY_DECODE_WORKERS, KK5JY_DECODE_QUEUE);
+
+	// start the capture worker
+	if (sem_init(&m_CaptureReady, 0, 0) != 0) {
+		delete m_Scheduler;
+		throw std::runtime_error("Could not create capture semaphore");
+	}
+	if (pthread_create(&m_CaptureThread, 0, capture_thread, this) != 0) {
+		sem_destroy(&m_CaptureReady);
+		delete m_Scheduler;
+		throw std::runtime_error("Could not start capture thread");
+	}
 }
 
 //
 //  ModemSoundDevice::dtor
 //
 inline ModemSoundDevice::~ModemSoundDevice() {
+	// stop the callbacks, then the worker
+	stop();
+	m_Shutdown = true;
+	sem_post(&m_CaptureReady);
+	pthread_join(m_CaptureThread, 0);
+	sem_destroy(&m_CaptureReady);
+
+	// wait for running decodes; the rest are dropped
+	delete m_Scheduler;
+	for (size_t i = 0; i != m_Decoding.size(); ++i)
+		delete m_Decoding[i];
+
+	// free the jobs the worker didn't get to; a stopped job has no
+	//    events after its Stop, and m_TxJob has no Stop yet
+	TxEvent *ev;
+	while ((ev = m_TxEvents.front()) != 0) {
+		if (ev->kind != TxEvent::Start)
+			delete ev->job;
+		m_TxEvents.pop();
+	}
+	for (size_t i = 0; i != m_TxQueue.size(); ++i)
+		delete m_TxQueue[i];
+	if (m_TxReady.load())
+		delete m_TxReady.load();
+	if (m_TxJob)
+		delete m_TxJob;
 	if (m_Filter)
 		delete m_Filter;
 }
 
+
+//
+//  capture_thread(...) - capture worker entry point
+//
+inline void *capture_thread(void *parent) {
+	ModemSoundDevice *dev = reinterpret_cast<ModemSoundDevice*>(parent);
+	if (dev)
+		dev->captureWorker();
+	return 0;
+}
+
+
+//
+//  ModemSoundDevice::captureWorker() - does all of the non-real-time
+//     work on behalf of the sound callback: allocating decoders, writing
+//     the WAV files, starting decodes, and logging.
+//
+inline void ModemSoundDevice::captureWorker() {
+	while ( ! m_Shutdown) {
+		// sleep until the callback posts something
+		if (sem_wait(&m_CaptureReady) != 0)
+			continue;
+
+		CaptureChunk *chunk;
+		while ((chunk = m_Capture.front()) != 0) {
+			switch (chunk->kind) {
+				case CaptureChunk::Samples:
+					m_History.write(chunk->data, chunk->count, chunk->time);
+
+					// the early pass decodes the start of the slot, once it is held
+					if (m_EarlyPending && m_History.newest() >= m_SlotStart + (m_EarlySamples / 12000.0)) {
+						m_EarlyPending = false;
+						startDecode(m_SlotStart, m_SlotStart, m_SlotStart + (m_EarlySamples / 12000.0), 1, &m_EarlySink);
+					}
+					break;
+
+				case CaptureChunk::SlotStart:
+					#ifdef VERBOSE_DEBUG
+					std::cerr << chunk->time << ": Start decode capture" << std::endl;
+					#endif
+
+					// a missed SlotEnd leaves the old window open; decode what we have
+					if (m_SlotOpen)
+						startDecode(m_SlotStart, m_SlotStart, chunk->time, m_Depth, this);
+
+					m_SlotStart = chunk->time;
+					m_SlotOpen = true;
+					m_EarlyPending = m_EarlyEnabled;
+					break;
+
+				case CaptureChunk::SlotEnd:
+					#ifdef VERBOSE_DEBUG
+					std::cerr << chunk->time << ": End decode capture." << std::endl;
+					#endif
+
+					// decode the window; an early pass not yet run is
+					//    covered by this one
+					if (m_SlotOpen)
+						startDecode(m_SlotStart, m_SlotStart, chunk->time, m_Depth, this);
+					m_SlotOpen = false;
+					m_EarlyPending = false;
+					break;
+			}
+			m_Capture.pop();
+		}
+
+		// TX state changes; the jobs are deleted under m_TxLock, so
+		//    txQueue() can read them
+		TxEvent *ev;
+		while ((ev = m_TxEvents.front()) != 0) {
+			my::locker lock(m_TxLock);
+			switch (ev->kind) {
+				case TxEvent::Start:
+					m_TxOnAir = ev->job;
+					std::cout << "TX: 1" << std::endl;
+					std::cout << "INFO: Enable modulator; sending #" << ev->job->info.id << "." << std::endl;
+					break;
+
+				case TxEvent::Stop:
+					if (m_TxOnAir == ev->job)
+						m_TxOnAir = 0;
+					delete ev->job;
+					std::cout << "TX: 0" << std::endl;
+					std::cout << "INFO: Disable modulator." << std::endl;
+					break;
+
+				case TxEvent::Skip:
+					std::cout << "INFO: Transmit #" << ev->job->info.id
+						<< (ev->job->cancelled ? " cancelled." : " skipped; its slot has passed.") << std::endl;
+					delete ev->job;
+					break;
+			}
+			std::cout.flush();
+			m_TxEvents.pop();
+		}
+
+		// the callback may have taken the ready message
+		promoteTx();
+
+		// report any data lost by the callback
+		size_t lost = m_Overruns.exchange(0);
+		if (lost) {
+			std::cerr << "WARN: Capture queue overrun; " << lost << " chunk(s) dropped" << std::endl;
+		}
+		lost = m_TxOverruns.exchange(0);
+		if (lost) {
+			std::cerr << "WARN: TX event queue overrun; " << lost << " event(s) dropped" << std::endl;
+		}
+	}
+}
+
+
+//
+//  ModemSoundDevice::startDecode(...) - copy a window of the receive
+//     audio to a new decode, and hand it to the decode scheduler; run()
+//     deletes it once it is done
+//
+inline bool ModemSoundDevice::startDecode(double label, double start, double end, short depth, KK5JY::FT8::IDecodeSink *sink) {
+	std::vector<int16_t> audio(static_cast<size_t>(::llrint((end - start) * m_History.rate())));
+	if (audio.empty())
+		return false;
+	m_History.read(start, &audio[0], audio.size());
+
+	// several slots may be queued or decoding at once, so each gets its
+	//    own file, when 'jt9' reads one
+	char name[32];
+	{
+		my::locker lock(m_DecodedLock);
+		snprintf(name, sizeof(name), "1%05u_000000.wav", m_FrameCounter);
+		m_FrameCounter = (m_FrameCounter + 1) % 100000;
+	}
+
+	KK5JY::FT8::Decode<float> *job = 0;
+	try {
+		job = new KK5JY::FT8::Decode<float>(m_Mode, m_TempDir + name, label, depth, sink);
+		job->write(&audio[0], audio.size());
+	} catch (const std::exception &ex) {
+		std::cerr << "ERR: Could not start decode: " << ex.what() << std::endl;
+		if (job)
+			delete job;
+		return false;
+	}
+
+	{
+		my::locker lock(m_DecodedLock);
+		m_Decoding.push_back(job);
+	}
+	job->startDecode(m_Scheduler);
+	return true;
+}
+
+
+//
+//  ModemSoundDevice::redecode(...)
+//
+inline bool ModemSoundDevice::redecode(long slot, short depth, double shift) {
+	// the same window as the capture of the slot
+	const double label = (slot * m_FrameSize) - (m_FrameSize - m_FrameStart);
+	const double start = label + shift;
+	const double end = (slot * m_FrameSize) + m_FrameEnd + shift;
+	if (start < m_History.oldest() || end > m_History.newest())
+		return false;
+	return startDecode(label, start, end, depth, this);
+}
+
+
+//
+//  ModemSoundDevice::promoteTx() - publish the head of the TX queue to the
+//     sound callback; only the callback takes it back out of m_TxReady,
+//     so nothing else ever frees a job the callback might be reading
+//
+inline void ModemSoundDevice::promoteTx() {
+	my::locker lock(m_TxLock);
+	if (m_TxQueue.empty() || m_TxReady.load(std::memory_order_acquire))
+		return;
+	TxJob *job = m_TxQueue.front();
+	m_TxQueue.pop_front();
+	m_TxReady.store(job, std::memory_order_release);
+}
+
+
+//
+//  ModemSoundDevice::post(...) - queue data for the capture worker; never
+//     blocks or allocates, so this is safe to call from the sound callback
+//
+inline void ModemSoundDevice::post(CaptureChunk::Kinds kind, const float *data, size_t count, double time) {
+	do {
+		CaptureChunk *chunk = m_Capture.acquire();
+		if ( ! chunk) {
+			m_Overruns.fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+
+		size_t ct = count < KK5JY_CAPTURE_CHUNK ? count : KK5JY_CAPTURE_CHUNK;
+		chunk->kind = kind;
+		chunk->time = time;
+		chunk->count = ct;
+		if (ct)
+			::memcpy(chunk->data, data, ct * sizeof(float));
+		m_Capture.commit();
+
+		data += ct;
+		count -= ct;
+		time += ct / 12000.0;
+	} while (count);
+
+	// wake the worker
+	sem_post(&m_CaptureReady);
+}
+
+
+//
+//  ModemSoundDevice::post(...) - hand a TX event to the capture worker;
+//     like the capture chunks, this never blocks or allocates
+//
+inline void ModemSoundDevice::post(TxEvent::Kinds kind, TxJob *job) {
+	TxEvent *ev = m_TxEvents.acquire();
+	if ( ! ev) {
+		// only when the worker is stuck; 'job' is never freed, which
+		//    is safe, as txQueue() may still show it
+		m_TxOverruns.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ev->kind = kind;
+	ev->job = job;
+	m_TxEvents.commit();
+
+	// wake the worker
+	sem_post(&m_CaptureReady);
+}
+
+//
+//  ModemSoundDevice::start()
+//
+inline bool ModemSoundDevice::start() {
+	if ( ! SoundCard::start())
+		return false;
+
+	// RtAudio reports the latency in frames; for a duplex stream that is
+	//    input and output together, which the user's offset can correct
+	try {
+		m_OutLatency = static_cast<double>(adc.getStreamLatency()) / m_Rate;
+	} catch (const RtAudioError &) {
+		m_OutLatency = 0;
+	}
+	std::cout << "INFO: Output latency is " << static_cast<int>(m_OutLatency * 1000) << "ms" << std::endl;
+	return true;
+}
+
+
+//
+//  ModemSoundDevice::samplesBefore(...)
+//
+inline size_t ModemSoundDevice::samplesBefore(double boundary, double sec, size_t ct) const {
+	double dt = boundary - sec;
+	if (dt < 0)
+		dt += m_FrameSize;
+	const double n = ::ceil((dt * m_Clock.rate()) / m_DecFact);
+	return (n < ct) ? static_cast<size_t>(n) : ct;
+}
+
+
 //
 //  ModemSoundDevice::setDepth(...)
 //
@@ -267,42 +879,88 @@ inline short ModemSoundDevice::setDepth(short depth) {
 }
 
 //
-//  ModemSoundDevice::run()
+//  ModemSoundDevice::decoded(...) - called on the decoder thread as each
+//     line arrives from 'jt9'
+//
+inline void ModemSoundDevice::decoded(double start, const std::string &line) {
+	queueDecoded(start, line, false);
+}
+
+
+//
+//  ModemSoundDevice::EarlySink - the sink for early pass decodes
+//
+inline void ModemSoundDevice::EarlySink::decoded(double start, const std::string &line) {
+	m_Device->queueDecoded(start, line, true);
+}
+
+inline void ModemSoundDevice::EarlySink::finished(double start) {
+	m_Device->finished(start);
+}
+
+
+//
+//  ModemSoundDevice::queueDecoded(...)
+//
+inline void ModemSoundDevice::queueDecoded(double start, const std::string &line, bool early) {
+	// skip the time field ("HHMMSS ")
+	if (line.size() <= 7)
+		return;
+	DecodedLine dl(static_cast<time_t>(::ceil(start)), line.substr(7), early);
+
+	my::locker lock(m_DecodedLock);
+	m_Decoded.push_back(dl);
+	m_DecodedReady.signal();
+}
+
+
+//
+//  ModemSoundDevice::finished(...) - called on the decoder thread when it
+//     is done; wakes run() so it can release the decoder
 //
-inline vector<DecodedLine> * ModemSoundDevice::run() {
-	KK5JY::FT8::Decode<float> *decoding = m_Decoding;
+inline void ModemSoundDevice::finished(double) {
+	my::locker lock(m_DecodedLock);
+	m_DecodeFinished = true;
+	m_DecodedReady.signal();
+}
+
 
+//
+//  ModemSoundDevice::run()
+//
+inline vector<DecodedLine> * ModemSoundDevice::run(double timeout) {
 	vector<DecodedLine> * decodedLinesVectorPtr = new vector<DecodedLine>;
-	
-	DecodedLine *dlPtr = 0;
-
-	if (decoding) {
-
-		std::deque<std::string> buffer;
-		if (decoding->isDone()) {
-			// fetch the decodes
-			decoding->getDecodes(buffer);
-			double when = ::ceil(m_Decoding->GetCaptureStart());
-			delete m_Decoding;
-
-			// and print them
-			m_Decoding = 0;
-			std::deque<std::string>::const_iterator i;
-			int count = 0;
-			for (i = buffer.begin(); i != buffer.end(); ++i) {
-				// std::cout << "D: " <<  << " " << (i->substr(7)) << std::endl;
-				//std::cout << static_cast<time_t>(when) << ";" <<(i->substr(7)) << std::endl;
-				dlPtr = new DecodedLine(static_cast<time_t>(when), (i->substr(7)));
-				(*decodedLinesVectorPtr).push_back((*dlPtr));
-				count ++;
+
+	// sleep until the decoder thread has something for us, then hand
+	//    over whatever has arrived so far, without waiting for the rest
+	//    of the slot to finish decoding
+	{
+		my::locker lock(m_DecodedLock);
+		while (m_Decoded.empty() && ! m_DecodeFinished) {
+			if ( ! m_DecodedReady.wait(m_DecodedLock, timeout))
+				break;
+		}
+		decodedLinesVectorPtr->assign(m_Decoded.begin(), m_Decoded.end());
+		m_Decoded.clear();
+		m_DecodeFinished = false;
+	}
+
+	// release the decoders that are finished
+	std::deque<KK5JY::FT8::Decode<float>*> done;
+	{
+		my::locker lock(m_DecodedLock);
+		std::deque<KK5JY::FT8::Decode<float>*>::iterator i = m_Decoding.begin();
+		while (i != m_Decoding.end()) {
+			if ((*i)->isDone()) {
+				done.push_back(*i);
+				i = m_Decoding.erase(i);
+			} else {
+				++i;
 			}
-			
-			// talk
-			// std::cout << "INFO: Decode cycle complete." << std::endl;
-			//std::cout.flush();
 		}
-		
 	}
+	for (size_t i = 0; i != done.size(); ++i)
+		delete done[i];
 
 	return decodedLinesVectorPtr;
 }
@@ -311,157 +969,253 @@ inline vector<DecodedLine> * ModemSoundDevice::run() {
 //
 //  ModemSoundDevice::transmit(...)
 //
-inline bool ModemSoundDevice::transmit(const std::string &message, double f0, TimeSlots slot) {
-	// encode to keying symbols
-	std::string linebuffer = KK5JY::FT8::encode(m_Mode, message);
+inline unsigned ModemSoundDevice::transmit(const std::string &message, double f0, TimeSlots slot, long target) {
+	return transmit(vector<TxStream>(1, TxStream(message, f0)), slot, target);
+}
 
-	// store the TX slot
-	m_Slot = slot;
 
-	// lock critical section from here to end of function
-	my::locker lock(m_Mutex);
+//
+//  ModemSoundDevice::transmit(streams, ...)
+//
+inline unsigned ModemSoundDevice::transmit(const vector<TxStream> &streams, TimeSlots slot, long target) {
+	if (streams.empty())
+		return 0;
+
+	// render the audio here, not in the sound card callback
+	TxJob *job = new TxJob();
+	job->info.state = TxStatus::Queued;
+	job->info.slot = slot;
+	job->info.target = (slot == AbsoluteSlot) ? target : 0;
+	job->info.streams = streams;
+	job->mfsk = new KK5JY::DSP::MFSK::Mixer<float>();
+	for (size_t i = 0; i != streams.size(); ++i) {
+		// encode to keying symbols
+		std::string linebuffer = KK5JY::FT8::encode(m_Mode, streams[i].message);
+		if (linebuffer.empty()) {
+			delete job;
+			return 0;
+		}
 
-	// either update or start a new modulator for this message
-	if ( ! m_MFSK) {
-		// queue a new modulator to handle the message
-		m_MFSK = new KK5JY::DSP::MFSK::Modulator<float>(
-			m_Rate, f0, m_bps, m_shift);
-		m_MFSK->setLead(m_Lead);
-		m_MFSK->setVolume(m_Volume);
+		KK5JY::DSP::MFSK::Modulator<float> *mod = new KK5JY::DSP::MFSK::Modulator<float>(
+			m_Rate, streams[i].f0, m_bps, m_shift, m_bt, m_EdgeSymbols);
+		mod->transmit(linebuffer, streams[i].f0);
+		job->mfsk->add(mod, streams[i].amplitude);
 	}
-
-	// update the message in the modulator
-	m_MFSK->transmit(linebuffer, f0);
+	job->mfsk->normalize();
+
+	// add it to the end of the queue
+	unsigned id;
+	{
+		my::locker lock(m_TxLock);
+		id = job->info.id = m_TxNextId++;
+		if ( ! m_TxNextId)
+			m_TxNextId = 1;
+		m_TxQueue.push_back(job);
+	}
+	promoteTx();
 
 	// success
-	return true;
+	return id;
 }
 
 
 //
-//  ModemSoundDevice::cancelTransmit
+//  ModemSoundDevice::cancelTransmit()
 //
 inline void ModemSoundDevice::cancelTransmit() {
-	// lock critical section from here to end of function
-	my::locker lock(m_Mutex);
+	std::deque<TxJob*> dropped;
+	{
+		my::locker lock(m_TxLock);
+		dropped.swap(m_TxQueue);
+
+		// the callback drops the ready message
+		TxJob *ready = m_TxReady.load(std::memory_order_acquire);
+		if (ready)
+			ready->cancelled = true;
+	}
+	for (size_t i = 0; i != dropped.size(); ++i)
+		delete dropped[i];
 
 	m_Abort = true; // tell the event handler to stop and clean up
 }
 
 
+//
+//  ModemSoundDevice::cancelTransmit(id)
+//
+inline bool ModemSoundDevice::cancelTransmit(unsigned id) {
+	TxJob *dropped = 0;
+	{
+		my::locker lock(m_TxLock);
+		for (std::deque<TxJob*>::iterator i = m_TxQueue.begin(); i != m_TxQueue.end(); ++i) {
+			if ((*i)->info.id == id) {
+				dropped = *i;
+				m_TxQueue.erase(i);
+				break;
+			}
+		}
+
+		if ( ! dropped) {
+			// the callback drops the ready message
+			TxJob *ready = m_TxReady.load(std::memory_order_acquire);
+			if (ready && ready->info.id == id) {
+				ready->cancelled = true;
+				return true;
+			}
+
+			// stop the one on the air; the worker's m_TxOnAir may lag
+			//    the callback, so only a job with this ID is stopped
+			if (m_TxAirId.load(std::memory_order_acquire) != id
+					&& ( ! m_TxOnAir || m_TxOnAir->info.id != id))
+				return false;
+			m_TxAbortId.store(id, std::memory_order_release);
+			return true;
+		}
+	}
+	delete dropped;
+	return true;
+}
+
+
+//
+//  ModemSoundDevice::txQueue() - the messages in the order they go out
+//
+inline vector<TxStatus> ModemSoundDevice::txQueue() {
+	vector<TxStatus> result;
+	my::locker lock(m_TxLock);
+
+	// jobs are only deleted under m_TxLock, so these stay valid
+	if (m_TxOnAir) {
+		result.push_back(m_TxOnAir->info);
+		result.back().state = TxStatus::Sending;
+	}
+	TxJob *ready = m_TxReady.load(std::memory_order_acquire);
+	if (ready && ready != m_TxOnAir && ! ready->cancelled) {
+		result.push_back(ready->info);
+		result.back().state = TxStatus::Ready;
+	}
+	for (size_t i = 0; i != m_TxQueue.size(); ++i)
+		result.push_back(m_TxQueue[i]->info);
+	return result;
+}
+
+
 //
 //  ModemSoundDevice::event - sound card event handler
 //
 inline void ModemSoundDevice::event(float *in, float *out, size_t count) {
-	// read the frame clock
-	double sec = m_Clock.seconds(m_FrameSize);
+	// the time of this buffer, from the number of samples before it
+	const double now = m_Clock.tick(count);
+	const double sec = fmod(now, m_FrameSize);
 
 	// set active flag
 	if (count) m_Active = true;
 
 	//
-	//  RECEIVER: feed the current decoder
+	//  RECEIVER: hand the audio to the capture worker
 	//
-	KK5JY::FT8::Decode<float> *decoder = m_Current;
-	if (decoder) {
-		if (m_Rate == 12000) {
-			// copy data into decode module
-			if ( ! m_Sending)
-				decoder->write(in, count);
-		} else {
-			// run decimation filter across the input
-			float *fp = in;
-			const float * const ep = in + count;
-			while (fp++ != ep) {
-				*fp = m_Filter->run(*fp);
-			}
 
-			// decimate the input
-			for (size_t i = 1; i != count / m_DecFact; ++i) {
-				in[i] = in[i * m_DecFact];
-			}
-
-			// copy data into decode module
-			if ( ! m_Sending)
-				decoder->write(in, count / m_DecFact);
-		}
+	// filter and decimate in one pass; only kept outputs are computed
+	size_t ct = count;
+	if (m_Rate != 12000)
+		ct = m_Filter->process(in, in, count);
 
-		// if frame ended, move current deocder to 'decoding' state
-		if (sec > m_FrameEnd && sec < m_FrameStart) {
-			#ifdef VERBOSE_DEBUG
-			std::cerr << sec << ": End decode capture." << std::endl;
-			#endif
+	// all of the receive audio goes to the history, except while sending
+	if (ct && ! m_Sending)
+		post(CaptureChunk::Samples, in, ct, now);
 
-			m_Decoding = m_Current;
-			m_Current = 0;
+	// the capture window opens and closes on the exact sample; if it was
+	//    missed (the clock stepped), it opens or closes at once
+	if (m_Capturing) {
+		size_t cut = (sec > m_FrameEnd && sec < m_FrameStart) ? 0 : samplesBefore(m_FrameEnd, sec, ct);
 
-			// and start it decoding
-			decoder->startDecode();
+		// if frame ended, tell the worker to start decoding
+		if (cut < ct) {
+			post(CaptureChunk::SlotEnd, 0, 0, now + (cut * m_DecFact) / m_Clock.rate());
+			m_Capturing = false;
 		}
 	} else {
-		if (sec >= m_FrameStart || sec < m_FrameEnd) {
-			#ifdef VERBOSE_DEBUG
-			std::cerr << sec << ": Start decode capture; frame counter = " << m_FrameCounter << std::endl;
-			#endif
-
-			std::string name = m_TempDir + "100000_000000.wav";
-			if (m_FrameCounter) {
-				name[9] = '1';
-			}
-			m_FrameCounter = ! m_FrameCounter;
-			m_Current = new KK5JY::FT8::Decode<float>(m_Mode, name, KK5JY::FT8::abstime(), m_Depth);
+		size_t cut = (sec >= m_FrameStart || sec < m_FrameEnd) ? 0 : samplesBefore(m_FrameStart, sec, ct);
+		if (cut < ct) {
+			post(CaptureChunk::SlotStart, 0, 0, now + (cut * m_DecFact) / m_Clock.rate());
+			m_Capturing = true;
 		}
 	}
 
 
 	//
-	//  TRANSMITTER - if a message is pending, send it at the next slot
+	//  TRANSMITTER - start the message at the head of the queue in its slot;
+	//     no locks are taken, and nothing is allocated or freed here
 	//
 
-	// lock critical section from here to end of function
-	my::locker lock(m_Mutex);
-
-	// if ready to transmit, but not yet sending, and at the start of the,
-	//    frame time, enable the transmitter
-	bool inWindow = ( ! m_Sending) && m_MFSK && (sec > m_TxWinStart) && (sec < m_TxWinEnd);
-	if (inWindow) {
-		bool thisSlot = ! m_Slot; // if NextSlot selected, transmit now
-		if ( ! thisSlot) {
-			int slot_num = static_cast<int>(m_Clock.seconds(60) / m_FrameSize);
-			thisSlot |= ((m_Slot == OddSlot) && (slot_num % 2));  // in odd window
-			thisSlot |= ((m_Slot == EvenSlot) && ! (slot_num % 2)); // in even window
+	// the next message to send is published with one pointer; only this
+	//    callback clears it, so it can't be freed while in use here
+	TxJob *ready = m_Sending ? 0 : m_TxReady.load(std::memory_order_acquire);
+	if (ready) {
+		// the time that the first sample of 'out' reaches the air, and
+		//    the slot it lands in
+		const double air = now + m_OutLatency.load(std::memory_order_relaxed) + m_TxOffset.load(std::memory_order_relaxed);
+		const double airSec = fmod(air, m_FrameSize);
+		const long slot_num = static_cast<long>(::floor(air / m_FrameSize));
+		bool passed = (ready->info.slot == AbsoluteSlot) && (slot_num > ready->info.target);
+		if (ready->cancelled || passed) {
+			// the worker reports it and frees it
+			m_TxReady.store(0, std::memory_order_release);
+			post(TxEvent::Skip, ready);
+		} else if ((airSec >= m_TxWinStart) && (airSec < m_TxWinEnd)) {
+			// if ready to transmit, but not yet sending, and at the start
+			//    of the frame time, enable the transmitter
+			bool thisSlot = false;
+			switch (ready->info.slot) {
+				case NextSlot: thisSlot = true; break; // transmit now
+				case OddSlot: thisSlot = (slot_num % 2); break;
+				case EvenSlot: thisSlot = ! (slot_num % 2); break;
+				case AbsoluteSlot: thisSlot = (slot_num == ready->info.target); break;
+			}
 
+			#ifdef VERBOSE_DEBUG
 			// DEBUG: very verbose output
-			std::cout
-				<< "TRACE: SlotTarget = " << m_Slot
+			std::cerr
+				<< "TRACE: SlotTarget = " << ready->info.slot
 				<< "; SlotNow = " << slot_num
-				<< "; sec = " << m_Clock.seconds(60)
 				<< "; thisSlot = " << thisSlot << std::endl;
-		}
-		if (thisSlot) {
-			std::cout << "TX: 1" << std::endl;
-			std::cout << "INFO: Enable modulator." << std::endl;
-			std::cout.flush();
+			#endif
 
-			m_Sending = true;
+			if (thisSlot) {
+				m_TxReady.store(0, std::memory_order_release);
+				m_TxJob = ready;
+				m_TxJob->mfsk->setVolume(m_Volume);
+
+				// pad with silence up to the exact sample, so that the
+				//    signal is on the air m_Lead after the boundary; if
+				//    that has passed, start late rather than cut it short
+				const double lead = ((slot_num * m_FrameSize) - air) * m_Clock.rate() + m_Lead;
+				m_TxJob->mfsk->setLead(lead > 0 ? static_cast<size_t>(::llrint(lead)) : 0);
+				m_Abort = false; // a STOP before this message doesn't apply to it
+				m_TxAirId.store(m_TxJob->info.id, std::memory_order_release);
+				post(TxEvent::Start, m_TxJob);
+				m_Sending = true;
+			}
 		}
 	}
 
 	// if already sending, keep going
 	if (m_Sending) {
 		// read data right into the I/O buffer
-		size_t ct = m_MFSK->read(out, count);
+		size_t ct = m_TxJob->mfsk->read(out, count);
 
 		// if data exhausted, shut down modulator
-		if (m_Abort || ! ct) {
-			std::cout << "TX: 0" << std::endl;
-			std::cout << "INFO: Disable modulator." << std::endl;
-			std::cout.flush();
+		// IDs are never reused, so an abort meant for a job that has
+		//    already finished matches nothing
+		const bool aborted = m_TxAbortId.load(std::memory_order_acquire) == m_TxJob->info.id;
+		if (m_Abort || aborted || m_TxJob->cancelled || ! ct) {
+			// the worker logs the change and frees the message
+			m_TxAirId.store(0, std::memory_order_release);
+			post(TxEvent::Stop, m_TxJob);
 
 			m_Sending = false;
 			m_Abort = false;
-			delete m_MFSK;
-			m_MFSK = 0;
+			m_TxJob = 0;
 		}
 
 		// zero out the rest of the memory
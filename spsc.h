@@ -0,0 +1,128 @@
+/*
+ *
+ *
+ *    spsc.h
+ *
+ *    Lock-free single-producer/single-consumer ring.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ */
+
+#ifndef __KK5JY_SPSC_H
+#define __KK5JY_SPSC_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+
+namespace my {
+	//
+	//  class spsc_ring<T> - fixed-capacity, preallocated ring of T
+	//
+	//  Exactly one thread may call the producer methods (acquire/commit)
+	//  and exactly one thread may call the consumer methods (front/pop).
+	//  Neither side ever blocks or allocates, so the producer side is
+	//  safe to use from a real-time audio callback.
+	//
+	template <typename T>
+	class spsc_ring {
+		private:
+			T *m_Items;
+			const size_t m_Size; // always a power of two
+			const size_t m_Mask;
+
+			// keep the indices on separate cache lines
+			alignas(64) std::atomic<size_t> m_Head; // next slot to write
+			alignas(64) std::atomic<size_t> m_Tail; // next slot to read
+
+		private: // disallowed
+			spsc_ring(const spsc_ring&);
+			spsc_ring &operator=(const spsc_ring&);
+
+		public:
+			spsc_ring(size_t size);
+			~spsc_ring() { delete [] m_Items; }
+
+		public: // producer side
+			// return the next free slot, or NULL if the ring is full
+			T *acquire();
+
+			// publish the slot returned by acquire()
+			void commit();
+
+		public: // consumer side
+			// return the oldest published slot, or NULL if the ring is empty
+			T *front();
+
+			// release the slot returned by front()
+			void pop();
+
+		public:
+			// the number of slots in the ring
+			size_t capacity() const { return m_Size; }
+
+			// the number of slots waiting to be read (approximate)
+			size_t size() const {
+				return m_Head.load(std::memory_order_acquire) - m_Tail.load(std::memory_order_acquire);
+			}
+	};
+
+
+	//
+	//  spsc_ring::ctor
+	//
+	template <typename T>
+	inline spsc_ring<T>::spsc_ring(size_t size)
+		: m_Items(0), m_Size(size), m_Mask(size - 1), m_Head(0), m_Tail(0) {
+		if (size == 0 || (size & (size - 1)) != 0)
+			throw std::runtime_error("Ring size must be a power of two");
+		m_Items = new T[m_Size];
+	}
+
+
+	//
+	//  spsc_ring::acquire()
+	//
+	template <typename T>
+	inline T *spsc_ring<T>::acquire() {
+		const size_t head = m_Head.load(std::memory_order_relaxed);
+		if (head - m_Tail.load(std::memory_order_acquire) == m_Size)
+			return 0;
+		return m_Items + (head & m_Mask);
+	}
+
+
+	//
+	//  spsc_ring::commit()
+	//
+	template <typename T>
+	inline void spsc_ring<T>::commit() {
+		m_Head.store(m_Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+
+	//
+	//  spsc_ring::front()
+	//
+	template <typename T>
+	inline T *spsc_ring<T>::front() {
+		const size_t tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail == m_Head.load(std::memory_order_acquire))
+			return 0;
+		return m_Items + (tail & m_Mask);
+	}
+
+
+	//
+	//  spsc_ring::pop()
+	//
+	template <typename T>
+	inline void spsc_ring<T>::pop() {
+		m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+}
+
+#endif // __KK5JY_SPSC_H
@@ -0,0 +1,221 @@
+/*
+ *
+ *
+ *    test_encode.cc
+ *
+ *    Test stand for the native message encoder.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    Encodes each message of a corpus in-process, and reports any
+ *    difference from the expected keying symbols.  For the built-in
+ *    corpus, those are kept below; for a corpus read from a file, with
+ *    one message per line, they come from the WSJT-X 'ft8code' or
+ *    'ft4code' tool, which must be on the PATH.
+ *
+ *    Usage:  ./test_encode <ft8|ft4> [corpus.txt]
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include "encode.h"
+#include "clock.h"
+
+using namespace KK5JY::FT8;
+using namespace std;
+
+// the built-in corpus, with the symbols for each message as the last
+//    line of WSJT-X 'ft8code "<message>"' and 'ft4code "<message>"'
+//    prints them; the table was filled from this encoder, after each
+//    codeword passed the decoder's parity checks and CRC and unpacked
+//    to the same text, and is to be confirmed with those tools by
+//    running the same messages from a file
+struct Expected {
+	const char *message;
+	const char *ft8;
+	const char *ft4;
+};
+
+static const Expected corpus[] = {
+	{ "CQ K1ABC FN42",
+		"3140652000000001005476704606021533433140652736011047517007334745455133543140652",
+		"0132103311233031311022211311130221023122331233121020312120023303212310121232302300012010023332113303201" },
+	{ "K1ABC W9XYZ EN37",
+		"3140652032247523504061147005134325373140652464557561564770300376175462233140652",
+		"0132100223021333231021012002331111023121233013000013231311102311112310021010122332102302303210201103201" },
+	{ "W9XYZ K1ABC -11",
+		"3140652020355725005476704617463024063140652536316515751700077044377507213140652",
+		"0132101312123203021022211311130221023033011003010303112130012320002310333312223210232023002123001123201" },
+	{ "K1ABC W9XYZ R-09",
+		"3140652032247523504061147027463527033140652323406130213743267634453040613140652",
+		"0132100223021333231021012002331111023333011033013321210300113232032310222010212120321020021321123123201" },
+	{ "K1ABC W9XYZ R EN37",
+		"3140652032247523504061147035134326763140652572211001730544055070003744033140652",
+		"0132100223021333231021012002331111023221233013002103120233023322102310203030313231132212121201010203201" },
+	{ "W9XYZ K1ABC RRR",
+		"3140652020355725005476704617455530313140652564305535161117524523127753273140652",
+		"0132101312123203021022211311130221023033013333130033131330111333022310323222000310031222202100111013201" },
+	{ "K1ABC W9XYZ RR73",
+		"3140652032247523504061147017455422543140652656077704107145041657342273103140652",
+		"0132100223021333231021012002331111023033013323022310032121302123322310231220323202323033011001210133201" },
+	{ "W9XYZ K1ABC 73",
+		"3140652020355725005476704617456027313140652614507505233746545070403065563140652",
+		"0132101312123203021022211311130221023033013203013033001310102323032310202010330201132210121320323323201" },
+	{ "K1ABC W9XYZ +05",
+		"3140652032247523504061147017464021473140652021556576121364254045316631403140652",
+		"0132100223021333231021012002331111023033010003032012110111112300122310213201012130132013133132132233201" },
+	{ "K1ABC W9XYZ -30",
+		"3140652032247523504061147017456335543140652506475734275714022106664545433140652",
+		"0132100223021333231021012002331111023033013213101310102101311133332310310012013313220001332221022203201" },
+	{ "K1ABC W9XYZ -45",
+		"3140652032247523504061147017473421143140652754152747740142402620670003513140652",
+		"0132100223021333231021012002331111023033001023033210332322132103202310303120201333321211300323113223201" },
+	{ "CQ DX K1ABC FN42",
+		"3140652000001047505476704606021524133140652372603155376066613120704715013140652",
+		"0132103311232022101022211311130221023122331233010221220213130213032310010231030023121210222203320223201" },
+	{ "CQ POTA K1ABC FN42",
+		"3140652000577647505476704606021523703140652000615714312007565615345100463140652",
+		"0132103301011312101022211311130221023122331233021131103013011120332310122232300221020313013333122323201" },
+	{ "CQ 290 K1ABC FN42",
+		"3140652000000333505476704606021521553140652230155144365762277007716243133140652",
+		"0132103311233132231022211311130221023122331233032301313022110203332310020011102110230030233001110103201" },
+	{ "QRZ K1ABC FN42",
+		"3140652000000000505476704606021522443140652347516661771357514645211572063140652",
+		"0132103311233031331022211311130221023122331233022011222210012211102310313201300320022013230121200323201" },
+	{ "DE K1ABC FN42",
+		"3140652000000000005476704606021525463140652415663674323735253546420726723140652",
+		"0132103311233031321022211311130221023122331233001003201012031200332310112013322133032000100202332113201" },
+	{ "CQ K1ABC",
+		"3140652000000001005476704617455326033140652410375372345677132250467242263140652",
+		"0132103311233031311022211311130221023033013313003320200031310001232310000020003003213110032001101023201" },
+	{ "K1ABC W9XYZ",
+		"3140652032247523504061147017455324543140652615750275761167565315424251233140652",
+		"0132100223021333231021012002331111023033013313011310001002120100002310323221000221100310102300131103201" },
+	{ "K1ABC/R W9XYZ/R FN42",
+		"3140652032247523404061147056021526213140652256256224276574530222440547223140652",
+		"0132100223021333232021012002331101023122331233003132332132113130332310310330010302111230010221001113201" },
+	{ "G4ABC/P PA9XYZ JO22",
+		"3140652033040342222473413510546556673140652125365204412473533331244335523140652",
+		"0132100211033122213100211120110211023010303232202212011031010123302310122300110303101103312312023213201" },
+	{ "VK2ABC ZL1XYZ RF70",
+		"3140652705005515174570224417140537003140652166171340423243556660236465563140652",
+		"0132333011223330020211311031000311023032202333113331031122323002002310112110210231323213213110323323201" },
+	{ "3DA0XYZ K1ABC KG53",
+		"3140652104732031505476704611047321443140652007576225613462413711241112733140652",
+		"0132133103331032301022211311130221023012303113032011102211313130012310222001101323010203310033202103201" },
+	{ "3XA1BC K1ABC",
+		"3140652675610441005476704617455326323140652255325204746673424021422205513140652",
+		"0132221000203222311022211311130221023033013313003022332030310123302310300320111310131200101003023223201" },
+	{ "PJ4/K1ABC <W9XYZ>",
+		"3140652754100016073153143630004104403140652260770176145261322551452103013140652",
+		"0132323110233030011201023132320221023211323000211031330002320200122310300111132313333100021033110223201" },
+	{ "<W9XYZ> PJ4/K1ABC RR73",
+		"3140652754100016073153143630006101063140652211604670335406132712433111723140652",
+		"0132323110233030011201023132320221023211323200233302300113101201032310100002333003310230111333232113201" },
+	{ "PJ4/K1ABC <W9XYZ> 73",
+		"3140652754100016073153143630007611403140652310172166217632341002174415723140652",
+		"0132323110233030011201023132320221023211323130332031200022333210132310221323202202230132302213322113201" },
+	{ "CQ PJ4/K1ABC",
+		"3140652000000016073153143630005206073140652040337166016431570726475464323140652",
+		"0132103311233030011201023132320221023211323310203312123030203210122310120303230212011300003210311213201" },
+	{ "<PJ4/K1ABC> W9XYZ",
+		"3140652004613406004061147017455322353140652034310541251451663433104155603140652",
+		"0132103100200231011021012002331111023033013313023001112330021302132310333301230123001122222330023133201" },
+	{ "TNX BOB 73 GL",
+		"3140652207447147063336401773500017703140652646427306546072440503670130533140652",
+		"0132033132021012111301100310122331023300322303312130022100303023112310000230101202030121300332123203201" },
+	{ "HELLO WORLD",
+		"3140652170010120024141142025030003273140652537717524336574117721040433163140652",
+		"0132121311203003321111020002321111023321332303220113112203002330332310100330013020311202010212110023201" },
+	{ "ABC+-./? 1234",
+		"3140652111431551012216631616333004433140652331637716310155121544035607653140652",
+		"0132132332332321311000132312022221023022032003211021213113202120132310123121323012332022113233003033201" },
+	{ 0, 0, 0 }
+};
+
+
+//
+//  encode_tool(...) - the symbols from 'ft8code' or 'ft4code'
+//
+static std::string encode_tool(const std::string &mode, const std::string &txt) {
+	std::string cmd = mode + "code \"" + txt + "\" | tail -1";
+	FILE *code = popen(cmd.c_str(), "r");
+	if ( ! code)
+		return "";
+
+	char iobuffer[128];
+	std::string linebuffer;
+	size_t ct;
+	while ((ct = fread(iobuffer, 1, sizeof(iobuffer), code)) != 0)
+		linebuffer.append(iobuffer, ct);
+	pclose(code);
+
+	// keep only the digits, as the modulator does
+	std::string result;
+	for (size_t i = 0; i != linebuffer.size(); ++i) {
+		if (isdigit(linebuffer[i]))
+			result += linebuffer[i];
+	}
+	return result;
+}
+
+
+int main(int argc, char**argv) {
+	if (argc < 2 || argc > 3) {
+		cerr << "Usage: " << argv[0] << " <ft8|ft4> [corpus.txt]" << endl;
+		return 1;
+	}
+	const std::string mode = my::toLower(argv[1]);
+
+	if (mode != "ft8" && mode != "ft4") {
+		cerr << "Invalid mode: " << argv[1] << endl;
+		return 1;
+	}
+
+	// load the corpus
+	std::vector<std::string> messages;
+	std::vector<std::string> expected;
+	if (argc == 3) {
+		std::ifstream in(argv[2]);
+		std::string line;
+		while (std::getline(in, line)) {
+			line = my::strip(line);
+			if ( ! line.empty())
+				messages.push_back(line);
+		}
+	} else {
+		for (const Expected *p = corpus; p->message; ++p) {
+			messages.push_back(p->message);
+			expected.push_back((mode == "ft4") ? p->ft4 : p->ft8);
+		}
+	}
+
+	// compare each message
+	int failures = 0;
+	for (size_t i = 0; i != messages.size(); ++i) {
+		double start = abstime();
+		std::string native = encode(mode, messages[i]);
+		double elapsed = abstime() - start;
+		std::string reference = expected.empty() ? encode_tool(mode, messages[i]) : expected[i];
+
+		bool ok = ! native.empty() && native == reference;
+		if ( ! ok)
+			++failures;
+		cout << (ok ? "OK  " : "FAIL") << "  " << static_cast<int>(elapsed * 1e6) << "us  '" << messages[i] << "'" << endl;
+		if ( ! ok) {
+			cout << "    native: " << native << endl;
+			cout << "    " << (expected.empty() ? mode + "code" : "expected") << ": " << reference << endl;
+		}
+	}
+
+	cout << (messages.size() - failures) << " of " << messages.size() << " messages match" << endl;
+	return failures ? 1 : 0;
+}
+
+// EOF
@@ -0,0 +1,91 @@
+/*
+ *
+ *
+ *    test_nco.cc
+ *
+ *    Test stand for the table oscillator.
+ *
+ *    Copyright (C) 2023 by Matt Roberts.
+ *    License: GNU GPL3 (www.gnu.org)
+ *
+ *
+ *    Measures the worst spur of Nco<double> at several frequencies, and
+ *    compares its speed with Osc<float>.  The test tones sit exactly on
+ *    FFT bins (a whole number of cycles per FFT), so no window is needed
+ *    and everything outside the tone's bin is spur.  Fails if any spur is
+ *    above KK5JY_NCO_SPUR_LIMIT dBc.
+ *
+ *    Usage:  ./test_nco [fs]
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include "osc.h"
+#include "fft.h"
+#include "clock.h"
+
+using namespace KK5JY::DSP;
+using namespace std;
+
+#ifndef KK5JY_NCO_SPUR_LIMIT
+#define KK5JY_NCO_SPUR_LIMIT (-110.0)
+#endif
+
+int main(int argc, char**argv) {
+	const double fs = (argc > 1) ? atof(argv[1]) : 48000.0;
+	const size_t N = 65536;
+	FFT<double> fft(N);
+	std::vector<FFT<double>::complex_t> in(N), out(N);
+	std::vector<double> samples(N);
+
+	// worst spur at several test frequencies
+	const size_t bins[] = { 1, 137, 2133, 8192, 12001, 21845, 32000, 0 };
+	double worst = -300;
+	for (const size_t *b = bins; *b; ++b) {
+		const double f = *b * fs / N;
+		Nco<double> nco(f, fs);
+		nco.read(&samples[0], N);
+		for (size_t i = 0; i != N; ++i)
+			in[i] = FFT<double>::complex_t(samples[i], 0);
+		fft.forward(&in[0], &out[0]);
+
+		const double carrier = std::norm(out[*b]);
+		double spur = 0;
+		for (size_t i = 1; i != N / 2; ++i) {
+			if (i != *b && std::norm(out[i]) > spur)
+				spur = std::norm(out[i]);
+		}
+		double dbc = 10.0 * log10((spur / carrier) + 1e-30);
+		if (dbc > worst)
+			worst = dbc;
+		cout << "f = " << f << " Hz: worst spur " << dbc << " dBc" << endl;
+	}
+
+	// speed, per sample
+	const size_t runs = 200;
+	std::vector<float> block(N);
+	Osc<float> osc(1234.5, fs);
+	double start = KK5JY::FT8::abstime();
+	for (size_t r = 0; r != runs; ++r)
+		for (size_t i = 0; i != N; ++i)
+			block[i] = osc.read();
+	double tOsc = KK5JY::FT8::abstime() - start;
+
+	Nco<float> nco(1234.5, fs);
+	start = KK5JY::FT8::abstime();
+	for (size_t r = 0; r != runs; ++r)
+		nco.read(&block[0], N);
+	double tNco = KK5JY::FT8::abstime() - start;
+
+	cout << "Osc: " << (tOsc * 1e9 / (runs * N)) << " ns/sample; Nco: "
+		<< (tNco * 1e9 / (runs * N)) << " ns/sample" << endl;
+
+	bool ok = worst <= KK5JY_NCO_SPUR_LIMIT;
+	cout << (ok ? "OK" : "FAIL") << ": worst spur " << worst << " dBc (limit " << KK5JY_NCO_SPUR_LIMIT << ")" << endl;
+	return ok ? 0 : 1;
+}
+
+// EOF